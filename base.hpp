@@ -41,7 +41,7 @@ protected:
 
     // Returns true if the object should self-delete.
     bool Release() const {
-        if (!__sync_fetch_and_sub(&ref_count_,1)) {
+        if (__sync_sub_and_fetch(&ref_count_, 1) == 0) {
             return true;
         }
         return false;
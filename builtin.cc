@@ -12,12 +12,14 @@ using namespace Interpreter;
                                ": the count of parameters not enough"); \
     }
 Value Println(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
-    std::string result;
+    ValueWriter writer(vm->GetOutput());
     for (std::vector<Value>::iterator iter = values.begin(); iter != values.end(); iter++) {
-        result += iter->ToString();
-        result += " ";
+        writer.Write(*iter);
+        writer.Append(' ');
     }
-    std::cout << result << std::endl;
+    writer.Append('\n');
+    writer.Flush();
+    fflush(vm->GetOutput());
     return Value();
 }
 
@@ -39,6 +41,18 @@ Value ToString(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     return Value(arg.ToString());
 }
 
+bool IsIntegerArray(const ArrayObject* array) {
+    if (array->GetStorage() == ArrayObject::kPackedInteger) {
+        return true;
+    }
+    for (size_t i = 0; i < array->size(); i++) {
+        if (array->Get(i).Type != ValueType::kInteger) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool IsIntegerArray(const std::vector<Value>& values) {
     std::vector<Value>::const_iterator iter = values.begin();
     while (iter != values.end()) {
@@ -50,22 +64,37 @@ bool IsIntegerArray(const std::vector<Value>& values) {
     return true;
 }
 
+void AppendIntegerArrayToBytes(Value& val, const ArrayObject* array) {
+    std::string& bytes = val.MutableBytes();
+    if (array->GetStorage() == ArrayObject::kPackedInteger) {
+        const std::vector<Value::INTVAR>& items = array->Integers();
+        bytes.reserve(bytes.size() + items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            bytes.push_back((unsigned char)items[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < array->size(); i++) {
+        bytes.push_back((unsigned char)array->Get(i).Integer);
+    }
+}
+
 void AppendIntegerArrayToBytes(Value& val, const std::vector<Value>& values) {
     std::vector<Value>::const_iterator iter = values.begin();
     while (iter != values.end()) {
-        val.bytes.append(1, (unsigned char)iter->Integer);
+        val.MutableBytes().append(1, (unsigned char)iter->Integer);
         iter++;
     }
 }
 
 Value append(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(values, 1);
-    Value to = values.front();
+    Value to = std::move(values.front());
     if (to.Type == ValueType::kArray) {
         std::vector<Value>::iterator iter = values.begin();
         iter++;
         while (iter != values.end()) {
-            to._array().push_back(*iter);
+            to.Array()->Push(std::move(*iter));
             iter++;
         }
         return to;
@@ -76,16 +105,16 @@ Value append(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
         while (iter != values.end()) {
             switch (iter->Type) {
             case ValueType::kBytes:
-                to.bytes += iter->bytes;
+                to.MutableBytes() += iter->Bytes();
                 break;
             case ValueType::kInteger:
-                to.bytes.append(1, (unsigned char)iter->Integer);
+                to.MutableBytes().append(1, (unsigned char)iter->Integer);
                 break;
             case ValueType::kArray:
-                if (!IsIntegerArray(iter->_array())) {
+                if (!IsIntegerArray(iter->Array())) {
                     throw RuntimeException("only integer array can append to bytes");
                 }
-                AppendIntegerArrayToBytes(to, iter->_array());
+                AppendIntegerArrayToBytes(to, iter->Array());
                 break;
             default:
                 throw RuntimeException(iter->ToString() + " can't append to bytes");
@@ -103,7 +132,7 @@ Value close(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     if (res.Type != ValueType::kResource) {
         throw RuntimeException("close parameter must a resource");
     }
-    res.resource->Close();
+    res.GetResource()->Close();
     return Value();
 }
 
@@ -126,7 +155,7 @@ Value Require(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     if (name.Type != ValueType::kString) {
         throw RuntimeException("require parameter must a string");
     }
-    vm->RequireScript(name.bytes, ctx);
+    vm->RequireScript(name.Bytes(), ctx);
     return Value();
 }
 
@@ -136,14 +165,14 @@ Value MakeBytes(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     }
     if (values.size() == 1) {
         if (values[0].Type == ValueType::kString || values[0].Type == ValueType::kBytes) {
-            return Value::make_bytes(values[0].bytes);
+            return Value::make_bytes(values[0].Bytes());
         }
         if (values[0].Type == ValueType::kArray) {
-            if (!IsIntegerArray(values[0]._array())) {
+            if (!IsIntegerArray(values[0].Array())) {
                 throw RuntimeException("make bytes must use integer array");
             }
             Value ret = Value::make_bytes("");
-            AppendIntegerArrayToBytes(ret, values[0]._array());
+            AppendIntegerArrayToBytes(ret, values[0].Array());
             return ret;
         }
     }
@@ -161,17 +190,17 @@ Value MakeString(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     }
     if (values.size() == 1) {
         if (values[0].Type == ValueType::kString || values[0].Type == ValueType::kBytes) {
-            return Value(values[0].bytes);
+            return Value(values[0].Bytes());
         }
         if (values[0].Type == ValueType::kFloat || values[0].Type == ValueType::kInteger) {
             return Value(values[0].ToString());
         }
         if (values[0].Type == ValueType::kArray) {
-            if (!IsIntegerArray(values[0]._array())) {
+            if (!IsIntegerArray(values[0].Array())) {
                 throw RuntimeException("convert to string must use integer array");
             }
             Value ret = Value::make_bytes("");
-            AppendIntegerArrayToBytes(ret, values[0]._array());
+            AppendIntegerArrayToBytes(ret, values[0].Array());
             ret.Type = ValueType::kString;
             return ret;
         }
@@ -210,9 +239,9 @@ Value HexDecodeString(std::vector<Value>& values, VMContext* ctx, Executor* vm)
     size_t i = 0;
     char buf[3] = {0};
     std::string result = "";
-    for (; i < arg.bytes.size(); i += 2) {
-        buf[0] = arg.bytes[i];
-        buf[1] = arg.bytes[i + 1];
+    for (; i < arg.Bytes().size(); i += 2) {
+        buf[0] = arg.Bytes()[i];
+        buf[1] = arg.Bytes()[i + 1];
         if (!IsHexChar(buf[0]) || !IsHexChar(buf[1])) {
             throw RuntimeException("HexDecodeString parameter string is not a valid hex string");
         }
@@ -229,7 +258,7 @@ Value HexEncode(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     switch (arg.Type) {
     case ValueType::kBytes:
     case ValueType::kString:
-        return Value(HexEncode(arg.bytes.c_str(), arg.bytes.size()));
+        return Value(HexEncode(arg.Bytes().c_str(), arg.Bytes().size()));
     case ValueType::kInteger:
         snprintf(buf, 16, "%llX", arg.Integer);
         return Value(buf);
@@ -249,7 +278,7 @@ Value ToInteger(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
         return Value((Value::INTVAR)arg.Float);
     case ValueType::kString:
     case ValueType::kBytes: {
-        Value::INTVAR val = strtoll(arg.bytes.c_str(), NULL, 0);
+        Value::INTVAR val = strtoll(arg.Bytes().c_str(), NULL, 0);
         return Value(val);
     }
     default:
@@ -267,7 +296,7 @@ Value ToFloat(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
         return arg;
     case ValueType::kString:
     case ValueType::kBytes: {
-        double val = strtod(arg.bytes.c_str(), NULL);
+        double val = strtod(arg.Bytes().c_str(), NULL);
         return Value(val);
     }
     default:
@@ -305,6 +334,30 @@ Value VMEnv(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     return ret;
 }
 
+Value HasKey(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(values, 2);
+    if (values[0].Type != ValueType::kMap) {
+        throw RuntimeException("HasKey first parameter must a map");
+    }
+    MAPTYPE& map = values[0]._map();
+    return Value(map.find(values[1]) != map.end());
+}
+
+Value Delete(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(values, 2);
+    if (values[0].Type != ValueType::kMap) {
+        throw RuntimeException("Delete first parameter must a map");
+    }
+    return Value(values[0]._map().erase(values[1]));
+}
+
+//counters of the value runtime,scripts use them to check what an operation costs
+Value VMStats(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
+    Value ret = Value::make_map();
+    ret._map()["String Allocations"] = Value(StringObject::sAllocations);
+    return ret;
+}
+
 Value GetAvaliableFunction(std::vector<Value>& values, VMContext* ctx, Executor* vm) {
     return vm->GetAvailableFunction(ctx);
 }
@@ -324,7 +377,10 @@ BuiltinMethod builtinFunction[] = {{"exit", Exit},
                                    {"HexDecodeString", HexDecodeString},
                                    {"HexEncode", HexEncode},
                                    {"VMEnv", VMEnv},
-                                   {"GetAvaliableFunction", GetAvaliableFunction}};
+                                   {"GetAvaliableFunction", GetAvaliableFunction},
+                                   {"VMStats", VMStats},
+                                   {"HasKey", HasKey},
+                                   {"Delete", Delete}};
 
 bool IsFunctionOverwriteEnabled(const std::string& name) {
     for (int i = 0; i < 8; i++) {
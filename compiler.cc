@@ -0,0 +1,612 @@
+#include "compiler.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "logger.hpp"
+
+namespace Interpreter {
+
+namespace ByteCodes {
+std::string ToString(Type op) {
+    switch (op) {
+#define BYTECODE_NAME(name, count) \
+    case k##name:                  \
+        return #name;
+        BYTECODE_LIST(BYTECODE_NAME)
+#undef BYTECODE_NAME
+    default:
+        return "Unknown";
+    }
+}
+
+int OperandCount(Type op) {
+    switch (op) {
+#define BYTECODE_COUNT(name, count) \
+    case k##name:                   \
+        return count;
+        BYTECODE_LIST(BYTECODE_COUNT)
+#undef BYTECODE_COUNT
+    default:
+        return 0;
+    }
+}
+} // namespace ByteCodes
+
+std::string ByteCode::Dump() const {
+    std::stringstream o;
+    o << "bytecode " << SymbolTable::Name(Name) << std::endl;
+    size_t pc = 0;
+    while (pc < Code.size()) {
+        ByteCodes::Type op = Code[pc];
+        o << "\t" << pc << "\t" << ByteCodes::ToString(op);
+        int count = ByteCodes::OperandCount(op);
+        for (int i = 1; i <= count; i++) {
+            o << " " << Code[pc + i];
+        }
+        switch (op) {
+        case ByteCodes::kConst:
+        case ByteCodes::kCopyConst:
+            o << "\t;" << Constants[Code[pc + 1]].ToString();
+            break;
+        case ByteCodes::kCall:
+        case ByteCodes::kReadVar:
+        case ByteCodes::kNewVar:
+        case ByteCodes::kWriteVar:
+        case ByteCodes::kUpdateVar:
+        case ByteCodes::kIncVar:
+        case ByteCodes::kDecVar:
+        case ByteCodes::kReadAtVar:
+        case ByteCodes::kWriteAt:
+        case ByteCodes::kSlice: {
+            const VarRef& var = Vars[Code[pc + 1]];
+            o << "\t;" << SymbolTable::Name(var.Name);
+            if (var.Slot >= 0) {
+                o << "(" << var.Depth << "," << var.Slot << ")";
+            }
+        } break;
+        default:
+            break;
+        }
+        o << std::endl;
+        pc += count + 1;
+    }
+    return o.str();
+}
+
+Compiler::Compiler(const Script* script, std::vector<ByteCode*>& holder)
+        : mScript(script), mHolder(holder), mCode(NULL), mInFunction(false) {}
+
+ByteCode* Compiler::NewByteCode(Symbol name, const Instruction* source) {
+    ByteCode* code = new ByteCode();
+    code->Name = name;
+    code->Source = source;
+    mHolder.push_back(code);
+    return code;
+}
+
+ByteCode* Compiler::CompileScript() {
+    mCode = NewByteCode(SymbolTable::Intern(mScript->Name), mScript->EntryPoint);
+    mInFunction = false;
+    CompileStatement(mScript->EntryPoint);
+    Emit(ByteCodes::kEnd);
+    return mCode;
+}
+
+ByteCode* Compiler::CompileFunction(const Instruction* func) {
+    mCode = NewByteCode(func->Name, func);
+    mInFunction = true;
+    if (func->Refs.size() == 2) {
+        mCode->HasParameters = true;
+        const Instruction* formalParameters = mScript->GetInstruction(func->Refs[1]);
+        InstructionList list = mScript->GetInstructions(formalParameters->Refs);
+        for (size_t i = 0; i < list.size(); i++) {
+            mCode->Parameters.push_back(list[i]->Name);
+        }
+    }
+    //parameters take the first slots of the function scope
+    const Instruction* body = mScript->GetInstruction(func->Refs[0]);
+    std::vector<Symbol> names = mCode->Parameters;
+    CollectDeclarations(body, names);
+    mCode->Scopes.push_back(names);
+    mScopes.push_back(0);
+    CompileStatement(body);
+    Emit(ByteCodes::kNil);
+    Emit(ByteCodes::kReturn);
+    return mCode;
+}
+
+int Compiler::Emit(ByteCodes::Type op) {
+    mCode->Code.push_back(op);
+    return mCode->Code.size() - 1;
+}
+int Compiler::Emit(ByteCodes::Type op, int operand) {
+    int pos = Emit(op);
+    mCode->Code.push_back(operand);
+    return pos;
+}
+int Compiler::Emit(ByteCodes::Type op, int operand1, int operand2) {
+    int pos = Emit(op, operand1);
+    mCode->Code.push_back(operand2);
+    return pos;
+}
+int Compiler::Emit(ByteCodes::Type op, int operand1, int operand2, int operand3) {
+    int pos = Emit(op, operand1, operand2);
+    mCode->Code.push_back(operand3);
+    return pos;
+}
+
+int Compiler::EmitJump(ByteCodes::Type op) {
+    Emit(op, -1);
+    return mCode->Code.size() - 1;
+}
+
+void Compiler::PatchJump(int pos) {
+    mCode->Code[pos] = mCode->Code.size();
+}
+
+void Compiler::PatchJumps(const std::vector<int>& list) {
+    for (size_t i = 0; i < list.size(); i++) {
+        PatchJump(list[i]);
+    }
+}
+
+void Compiler::EmitThrow(const std::string& msg) {
+    Emit(ByteCodes::kThrow, AddConst(Value(msg)));
+}
+
+int Compiler::AddConst(const Value& val) {
+    mCode->Constants.push_back(val);
+    return mCode->Constants.size() - 1;
+}
+
+//resolve the name to the innermost scope which declared it
+int Compiler::AddVar(Symbol name) {
+    ByteCode::VarRef var = {name, 0, -1};
+    for (int i = (int)mScopes.size() - 1; i >= 0; i--) {
+        const std::vector<Symbol>& names = mCode->Scopes[mScopes[i]];
+        for (size_t j = 0; j < names.size(); j++) {
+            if (names[j] == name) {
+                var.Depth = mScopes.size() - 1 - i;
+                var.Slot = j;
+                break;
+            }
+        }
+        if (var.Slot != -1) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < mCode->Vars.size(); i++) {
+        const ByteCode::VarRef& item = mCode->Vars[i];
+        if (item.Name == name && item.Depth == var.Depth && item.Slot == var.Slot) {
+            return i;
+        }
+    }
+    mCode->Vars.push_back(var);
+    return mCode->Vars.size() - 1;
+}
+
+void Compiler::EnterScope(VMContext::Type type, const InstructionList& body) {
+    std::vector<Symbol> names;
+    for (size_t i = 0; i < body.size(); i++) {
+        CollectDeclarations(body[i], names);
+    }
+    mCode->Scopes.push_back(names);
+    mScopes.push_back(mCode->Scopes.size() - 1);
+    Emit(ByteCodes::kEnterScope, type, mScopes.back());
+}
+
+void Compiler::LeaveScope() {
+    mScopes.pop_back();
+    Emit(ByteCodes::kLeaveScope);
+}
+
+//collect variables declared directly in the scope,nested scopes and functions are skipped
+void Compiler::CollectDeclarations(const Instruction* ins, std::vector<Symbol>& names) {
+    switch (ins->OpCode) {
+    case Instructions::kConst:
+    case Instructions::kConstObject:
+    case Instructions::kFORStatement:
+    case Instructions::kForInStatement:
+    case Instructions::kSwitchCaseStatement:
+    case Instructions::kNewFunction:
+        return;
+    case Instructions::kNewVar:
+        if (std::find(names.begin(), names.end(), ins->Name) == names.end()) {
+            names.push_back(ins->Name);
+        }
+        break;
+    default:
+        break;
+    }
+    for (size_t i = 0; i < ins->Refs.size(); i++) {
+        CollectDeclarations(mScript->GetInstruction(ins->Refs[i]), names);
+    }
+}
+
+int Compiler::AddFunction(const Instruction* func) {
+    Compiler compiler(mScript, mHolder);
+    mCode->Functions.push_back(compiler.CompileFunction(func));
+    return mCode->Functions.size() - 1;
+}
+
+void Compiler::CompileStatement(const Instruction* ins) {
+    if (ins->OpCode >= Instructions::kWrite && ins->OpCode <= Instructions::kRSHIFTWrite) {
+        CompileUpdateVar(ins);
+        return;
+    }
+    switch (ins->OpCode) {
+    case Instructions::kNop:
+        return;
+    case Instructions::kGroup: {
+        InstructionList list = mScript->GetInstructions(ins->Refs);
+        for (size_t i = 0; i < list.size(); i++) {
+            CompileStatement(list[i]);
+        }
+        return;
+    }
+    case Instructions::kNewVar:
+        Emit(ByteCodes::kNewVar, AddVar(ins->Name));
+        if (ins->Refs.size()) {
+            CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+            Emit(ByteCodes::kWriteVar, AddVar(ins->Name));
+        }
+        return;
+    case Instructions::kNewFunction:
+        if (ins->Name != SymbolTable::kEmpty) {
+            Emit(ByteCodes::kNewFunction, AddFunction(ins));
+            return;
+        }
+        break;
+    case Instructions::kIFStatement:
+        CompileIFStatement(ins);
+        return;
+    case Instructions::kContitionExpression: {
+        std::vector<int> endJumps;
+        CompileConditionExpression(ins, endJumps);
+        PatchJumps(endJumps);
+        return;
+    }
+    case Instructions::kRETURNStatement:
+        CompileReturnStatement(ins);
+        return;
+    case Instructions::kFORStatement:
+        CompileForStatement(ins);
+        return;
+    case Instructions::kForInStatement:
+        CompileForInStatement(ins);
+        return;
+    case Instructions::kSwitchCaseStatement:
+        CompileSwitchStatement(ins);
+        return;
+    case Instructions::kBREAKStatement:
+        CompileBreakStatement();
+        return;
+    case Instructions::kCONTINUEStatement:
+        CompileContinueStatement();
+        return;
+    case Instructions::kWriteAt:
+        CompileWriteAt(ins);
+        return;
+    default:
+        break;
+    }
+    CompileExpression(ins);
+    Emit(ByteCodes::kPop);
+}
+
+void Compiler::CompileExpression(const Instruction* ins) {
+    static const ByteCodes::Type arithmetic[] = {
+            ByteCodes::kADD,  ByteCodes::kSUB,    ByteCodes::kMUL,    ByteCodes::kDIV,
+            ByteCodes::kMOD,  ByteCodes::kGT,     ByteCodes::kGE,     ByteCodes::kLT,
+            ByteCodes::kLE,   ByteCodes::kEQ,     ByteCodes::kNE,     ByteCodes::kNot,
+            ByteCodes::kBOR,  ByteCodes::kBAND,   ByteCodes::kBXOR,   ByteCodes::kBNG,
+            ByteCodes::kLSHIFT, ByteCodes::kRSHIFT, ByteCodes::kOR,   ByteCodes::kAND,
+    };
+    if (ins->OpCode >= Instructions::kADD && ins->OpCode <= Instructions::kMAXArithmeticOP) {
+        CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+        if (ins->OpCode != Instructions::kNOT && ins->OpCode != Instructions::kBNG) {
+            CompileExpression(mScript->GetInstruction(ins->Refs[1]));
+        }
+        Emit(arithmetic[ins->OpCode - Instructions::kADD]);
+        return;
+    }
+    switch (ins->OpCode) {
+    case Instructions::kNop:
+        Emit(ByteCodes::kNil);
+        return;
+    case Instructions::kConst:
+        Emit(ByteCodes::kConst, AddConst(mScript->GetConstValue(ins->Refs[0])));
+        return;
+    case Instructions::kConstObject:
+        Emit(ByteCodes::kCopyConst, AddConst(mScript->GetConstValue(ins->Refs[0])));
+        return;
+    case Instructions::kReadVar: {
+        //builtin constants can't be declared or changed,so read them once here
+        Value val;
+        if (VMContext::GetBuiltinVar(ins->Name, val)) {
+            Emit(ByteCodes::kConst, AddConst(val));
+            return;
+        }
+        Emit(ByteCodes::kReadVar, AddVar(ins->Name));
+        return;
+    }
+    case Instructions::kMinus:
+        CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+        Emit(ByteCodes::kMinus);
+        return;
+    case Instructions::kNewFunction:
+        Emit(ByteCodes::kMakeFunction, AddFunction(ins));
+        return;
+    case Instructions::kCallFunction:
+        CompileFunctionCall(ins);
+        return;
+    case Instructions::kCreateMap:
+        CompileCreateMap(ins);
+        return;
+    case Instructions::kCreateArray:
+        CompileCreateArray(ins);
+        return;
+    case Instructions::kReadAt:
+        CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+        if (ins->Refs.size() == 1) {
+            Emit(ByteCodes::kReadAtVar, AddVar(ins->Name));
+            return;
+        }
+        CompileExpression(mScript->GetInstruction(ins->Refs[1]));
+        Emit(ByteCodes::kReadAt);
+        return;
+    case Instructions::kSlice:
+        CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+        CompileExpression(mScript->GetInstruction(ins->Refs[1]));
+        Emit(ByteCodes::kSlice, AddVar(ins->Name));
+        return;
+    case Instructions::kGroup:
+    case Instructions::kNewVar:
+    case Instructions::kIFStatement:
+    case Instructions::kContitionExpression:
+    case Instructions::kRETURNStatement:
+    case Instructions::kFORStatement:
+    case Instructions::kForInStatement:
+    case Instructions::kSwitchCaseStatement:
+    case Instructions::kBREAKStatement:
+    case Instructions::kCONTINUEStatement:
+    case Instructions::kWriteAt:
+        CompileStatement(ins);
+        Emit(ByteCodes::kNil);
+        return;
+    default:
+        if (ins->OpCode >= Instructions::kWrite && ins->OpCode <= Instructions::kRSHIFTWrite) {
+            CompileStatement(ins);
+            Emit(ByteCodes::kNil);
+            return;
+        }
+        LOG("Unknown Instruction:" + ins->ToString());
+        Emit(ByteCodes::kNil);
+        return;
+    }
+}
+
+void Compiler::CompileUpdateVar(const Instruction* ins) {
+    int name = AddVar(ins->Name);
+    switch (ins->OpCode) {
+    case Instructions::kINCWrite:
+        Emit(ByteCodes::kIncVar, name);
+        return;
+    case Instructions::kDECWrite:
+        Emit(ByteCodes::kDecVar, name);
+        return;
+    default:
+        break;
+    }
+    if (ins->Refs.size()) {
+        CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+    } else {
+        Emit(ByteCodes::kNil);
+    }
+    if (ins->OpCode == Instructions::kWrite) {
+        Emit(ByteCodes::kWriteVar, name);
+        return;
+    }
+    Emit(ByteCodes::kUpdateVar, name, ins->OpCode);
+}
+
+void Compiler::CompileConditionExpression(const Instruction* ins, std::vector<int>& endJumps) {
+    CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+    int next = EmitJump(ByteCodes::kJumpIfFalse);
+    CompileStatement(mScript->GetInstruction(ins->Refs[1]));
+    endJumps.push_back(EmitJump(ByteCodes::kJump));
+    PatchJump(next);
+}
+
+void Compiler::CompileIFStatement(const Instruction* ins) {
+    std::vector<int> endJumps;
+    CompileConditionExpression(mScript->GetInstruction(ins->Refs[0]), endJumps);
+    const Instruction* branchs = mScript->GetInstruction(ins->Refs[1]);
+    if (branchs->OpCode != Instructions::kNop) {
+        InstructionList list = mScript->GetInstructions(branchs->Refs);
+        for (size_t i = 0; i < list.size(); i++) {
+            CompileConditionExpression(list[i], endJumps);
+        }
+    }
+    CompileStatement(mScript->GetInstruction(ins->Refs[2]));
+    PatchJumps(endJumps);
+}
+
+void Compiler::CompileForStatement(const Instruction* ins) {
+    const Instruction* init = mScript->GetInstruction(ins->Refs[0]);
+    const Instruction* condition = mScript->GetInstruction(ins->Refs[1]);
+    const Instruction* after = mScript->GetInstruction(ins->Refs[2]);
+    const Instruction* block = mScript->GetInstruction(ins->Refs[3]);
+    EnterScope(VMContext::For, mScript->GetInstructions(ins->Refs));
+    CompileStatement(init);
+    int top = mCode->Code.size();
+    int exit = -1;
+    if (!condition->IsNULL()) {
+        CompileExpression(condition);
+        exit = EmitJump(ByteCodes::kJumpIfFalse);
+    }
+    mBreakable.push_back(BreakableScope(VMContext::For));
+    CompileStatement(block);
+    BreakableScope scope = mBreakable.back();
+    mBreakable.pop_back();
+    PatchJumps(scope.ContinueJumps);
+    CompileStatement(after);
+    Emit(ByteCodes::kJump, top);
+    if (exit != -1) {
+        PatchJump(exit);
+    }
+    PatchJumps(scope.BreakJumps);
+    LeaveScope();
+}
+
+void Compiler::CompileForInStatement(const Instruction* ins) {
+    std::list<std::string> key_val = split(ins->GetName(), ',');
+    std::string key = key_val.front(), val = key_val.back();
+    EnterScope(VMContext::For, mScript->GetInstructions(ins->Refs));
+    CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+    Emit(ByteCodes::kForInBegin);
+    int top = mCode->Code.size();
+    Emit(ByteCodes::kForInNext, key.size() ? AddVar(SymbolTable::Intern(key)) : -1,
+         AddVar(SymbolTable::Intern(val)), -1);
+    int exit = mCode->Code.size() - 1;
+    mBreakable.push_back(BreakableScope(VMContext::For));
+    CompileStatement(mScript->GetInstruction(ins->Refs[1]));
+    BreakableScope scope = mBreakable.back();
+    mBreakable.pop_back();
+    Emit(ByteCodes::kJump, top);
+    for (size_t i = 0; i < scope.ContinueJumps.size(); i++) {
+        mCode->Code[scope.ContinueJumps[i]] = top;
+    }
+    PatchJump(exit);
+    PatchJumps(scope.BreakJumps);
+    Emit(ByteCodes::kForInEnd);
+    LeaveScope();
+}
+
+//stack layout while the cases running: [value,casehit]
+void Compiler::CompileSwitchStatement(const Instruction* ins) {
+    const Instruction* cases = mScript->GetInstruction(ins->Refs[1]);
+    const Instruction* defaultBranch = mScript->GetInstruction(ins->Refs[2]);
+    InstructionList case_array = mScript->GetInstructions(cases->Refs);
+    EnterScope(VMContext::Switch, mScript->GetInstructions(ins->Refs));
+    CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+    Emit(ByteCodes::kConst, AddConst(Value(false)));
+    mBreakable.push_back(BreakableScope(VMContext::Switch));
+    for (size_t i = 0; i < case_array.size(); i++) {
+        const Instruction* conditions = mScript->GetInstruction(case_array[i]->Refs[0]);
+        InstructionList values = mScript->GetInstructions(conditions->Refs);
+        std::vector<int> hits;
+        for (size_t j = 0; j < values.size(); j++) {
+            Emit(ByteCodes::kPick, 1);
+            CompileExpression(values[j]);
+            Emit(ByteCodes::kEQ);
+            hits.push_back(EmitJump(ByteCodes::kJumpIfTrue));
+        }
+        int next = EmitJump(ByteCodes::kJump);
+        PatchJumps(hits);
+        Emit(ByteCodes::kPop);
+        Emit(ByteCodes::kConst, AddConst(Value(true)));
+        CompileStatement(mScript->GetInstruction(case_array[i]->Refs[1]));
+        PatchJump(next);
+    }
+    BreakableScope scope = mBreakable.back();
+    mBreakable.pop_back();
+    int skipDefault = EmitJump(ByteCodes::kJumpIfTrue);
+    mBreakable.push_back(BreakableScope(VMContext::Switch));
+    CompileStatement(defaultBranch);
+    BreakableScope defaultScope = mBreakable.back();
+    mBreakable.pop_back();
+    PatchJump(skipDefault);
+    PatchJumps(defaultScope.BreakJumps);
+    int leave = EmitJump(ByteCodes::kJump);
+    PatchJumps(scope.BreakJumps);
+    Emit(ByteCodes::kPop);
+    PatchJump(leave);
+    Emit(ByteCodes::kPop);
+    LeaveScope();
+}
+
+void Compiler::CompileBreakStatement() {
+    if (mBreakable.size() == 0) {
+        EmitThrow("break only avaliable in for or switch statement");
+        return;
+    }
+    mBreakable.back().BreakJumps.push_back(EmitJump(ByteCodes::kJump));
+}
+
+void Compiler::CompileContinueStatement() {
+    if (mBreakable.size() == 0 || mBreakable.back().Type != VMContext::For) {
+        EmitThrow("continue only avaliable in for statement");
+        return;
+    }
+    mBreakable.back().ContinueJumps.push_back(EmitJump(ByteCodes::kJump));
+}
+
+void Compiler::CompileReturnStatement(const Instruction* ins) {
+    CompileExpression(mScript->GetInstruction(ins->Refs[0]));
+    if (!mInFunction) {
+        EmitThrow("return only avaliable in function statement");
+        return;
+    }
+    Emit(ByteCodes::kReturn);
+}
+
+void Compiler::CompileFunctionCall(const Instruction* ins) {
+    int count = 0;
+    if (ins->Refs.size() == 1) {
+        const Instruction* args = mScript->GetInstruction(ins->Refs[0]);
+        InstructionList list = mScript->GetInstructions(args->Refs);
+        for (size_t i = 0; i < list.size(); i++) {
+            CompileExpression(list[i]);
+        }
+        count = list.size();
+    }
+    ByteCode::CallCache cache = {0, NULL, NULL};
+    mCode->CallCaches.push_back(cache);
+    Emit(ByteCodes::kCall, AddVar(ins->Name), count, mCode->CallCaches.size() - 1);
+}
+
+void Compiler::CompileCreateMap(const Instruction* ins) {
+    const Instruction* list = mScript->GetInstruction(ins->Refs[0]);
+    if (list->OpCode == Instructions::kNop) {
+        Emit(ByteCodes::kCreateMap, 0);
+        return;
+    }
+    InstructionList items = mScript->GetInstructions(list->Refs);
+    for (size_t i = 0; i < items.size(); i++) {
+        CompileExpression(mScript->GetInstruction(items[i]->Refs[0]));
+        CompileExpression(mScript->GetInstruction(items[i]->Refs[1]));
+    }
+    Emit(ByteCodes::kCreateMap, items.size());
+}
+
+void Compiler::CompileCreateArray(const Instruction* ins) {
+    const Instruction* list = mScript->GetInstruction(ins->Refs[0]);
+    if (list->OpCode == Instructions::kNop) {
+        Emit(ByteCodes::kCreateArray, 0);
+        return;
+    }
+    InstructionList items = mScript->GetInstructions(list->Refs);
+    for (size_t i = 0; i < items.size(); i++) {
+        CompileExpression(items[i]);
+    }
+    Emit(ByteCodes::kCreateArray, items.size());
+}
+
+void Compiler::CompileWriteAt(const Instruction* ins) {
+    const Instruction* where = mScript->GetInstruction(ins->Refs[0]);
+    CompileExpression(mScript->GetInstruction(ins->Refs[1]));
+    if (where->OpCode != Instructions::kGroup) {
+        CompileExpression(where);
+        Emit(ByteCodes::kWriteAt, AddVar(ins->Name), 1);
+        return;
+    }
+    InstructionList list = mScript->GetInstructions(where->Refs);
+    for (size_t i = 0; i < list.size(); i++) {
+        CompileExpression(list[i]);
+    }
+    Emit(ByteCodes::kWriteAt, AddVar(ins->Name), list.size());
+}
+
+} // namespace Interpreter
@@ -0,0 +1,193 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "script.hpp"
+#include "value.hpp"
+#include "vmcontext.hpp"
+
+namespace Interpreter {
+
+//V(name, operand count)
+#define BYTECODE_LIST(V) \
+    V(Nop, 0)            \
+    V(Const, 1)          \
+    V(Nil, 0)            \
+    V(Pop, 0)            \
+    V(Pick, 1)           \
+    V(ReadVar, 1)        \
+    V(NewVar, 1)         \
+    V(WriteVar, 1)       \
+    V(UpdateVar, 2)      \
+    V(IncVar, 1)         \
+    V(DecVar, 1)         \
+    V(Minus, 0)          \
+    V(Not, 0)            \
+    V(BNG, 0)            \
+    V(ADD, 0)            \
+    V(SUB, 0)            \
+    V(MUL, 0)            \
+    V(DIV, 0)            \
+    V(MOD, 0)            \
+    V(GT, 0)             \
+    V(GE, 0)             \
+    V(LT, 0)             \
+    V(LE, 0)             \
+    V(EQ, 0)             \
+    V(NE, 0)             \
+    V(BOR, 0)            \
+    V(BAND, 0)           \
+    V(BXOR, 0)           \
+    V(LSHIFT, 0)         \
+    V(RSHIFT, 0)         \
+    V(OR, 0)             \
+    V(AND, 0)            \
+    V(ADD_II, 0)         \
+    V(ADD_FF, 0)         \
+    V(SUB_II, 0)         \
+    V(SUB_FF, 0)         \
+    V(MUL_II, 0)         \
+    V(MUL_FF, 0)         \
+    V(GT_II, 0)          \
+    V(GT_FF, 0)          \
+    V(GE_II, 0)          \
+    V(GE_FF, 0)          \
+    V(LT_II, 0)          \
+    V(LT_FF, 0)          \
+    V(LE_II, 0)          \
+    V(LE_FF, 0)          \
+    V(EQ_II, 0)          \
+    V(EQ_FF, 0)          \
+    V(NE_II, 0)          \
+    V(NE_FF, 0)          \
+    V(Jump, 1)           \
+    V(JumpIfFalse, 1)    \
+    V(JumpIfTrue, 1)     \
+    V(EnterScope, 2)     \
+    V(LeaveScope, 0)     \
+    V(Call, 3)           \
+    V(NewFunction, 1)    \
+    V(MakeFunction, 1)   \
+    V(Return, 0)         \
+    V(Throw, 1)          \
+    V(CreateMap, 1)      \
+    V(CreateArray, 1)    \
+    V(CopyConst, 1)      \
+    V(ReadAt, 0)         \
+    V(ReadAtVar, 1)      \
+    V(WriteAt, 2)        \
+    V(Slice, 1)          \
+    V(ForInBegin, 0)     \
+    V(ForInNext, 3)      \
+    V(ForInEnd, 0)       \
+    V(End, 0)
+
+namespace ByteCodes {
+typedef int Type;
+enum {
+#define BYTECODE_ENUM(name, count) k##name,
+    BYTECODE_LIST(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+    kMaxByteCode
+};
+std::string ToString(Type op);
+int OperandCount(Type op);
+} // namespace ByteCodes
+
+//the linear code of one function (or of a script's top level block)
+//every opcode is followed by its operands,jump operands are absolute offsets
+class ByteCode {
+public:
+    //a variable reference,Slot is -1 when the variable must be looked up by name
+    struct VarRef {
+        Symbol Name;
+        int Depth;
+        int Slot;
+    };
+    //the function resolved by a call site
+    struct CallCache {
+        unsigned int Version;
+        const ByteCode* Function;
+        RUNTIME_FUNCTION Builtin;
+    };
+    Symbol Name;
+    const Instruction* Source;
+    bool HasParameters;
+    std::vector<Symbol> Parameters;
+    //generic arithmetic and compare are quickened in place by the executor
+    mutable std::vector<int> Code;
+    std::vector<Value> Constants;
+    std::vector<VarRef> Vars;
+    //slot layout of every scope created by this code,for function the first one is
+    //the function scope
+    std::vector<std::vector<Symbol>> Scopes;
+    std::vector<const ByteCode*> Functions;
+    //filled by the executor while running
+    mutable std::vector<CallCache> CallCaches;
+
+public:
+    ByteCode() : Name(SymbolTable::kEmpty), Source(NULL), HasParameters(false) {}
+    std::string Dump() const;
+};
+
+//Compiler lowers the instruction tree of a script into ByteCode,
+//all created ByteCode (include nested functions) are appended to the holder
+class Compiler {
+public:
+    Compiler(const Script* script, std::vector<ByteCode*>& holder);
+
+    ByteCode* CompileScript();
+    ByteCode* CompileFunction(const Instruction* func);
+
+protected:
+    //break or continue jumps wait for patch
+    struct BreakableScope {
+        VMContext::Type Type;
+        std::vector<int> BreakJumps;
+        std::vector<int> ContinueJumps;
+        explicit BreakableScope(VMContext::Type type) : Type(type) {}
+    };
+
+    void CompileStatement(const Instruction* ins);
+    void CompileExpression(const Instruction* ins);
+    void CompileUpdateVar(const Instruction* ins);
+    void CompileIFStatement(const Instruction* ins);
+    void CompileConditionExpression(const Instruction* ins, std::vector<int>& endJumps);
+    void CompileForStatement(const Instruction* ins);
+    void CompileForInStatement(const Instruction* ins);
+    void CompileSwitchStatement(const Instruction* ins);
+    void CompileBreakStatement();
+    void CompileContinueStatement();
+    void CompileReturnStatement(const Instruction* ins);
+    void CompileFunctionCall(const Instruction* ins);
+    void CompileCreateMap(const Instruction* ins);
+    void CompileCreateArray(const Instruction* ins);
+    void CompileWriteAt(const Instruction* ins);
+
+    int Emit(ByteCodes::Type op);
+    int Emit(ByteCodes::Type op, int operand);
+    int Emit(ByteCodes::Type op, int operand1, int operand2);
+    int Emit(ByteCodes::Type op, int operand1, int operand2, int operand3);
+    //emit a jump instruction,returns the position of the jump target operand
+    int EmitJump(ByteCodes::Type op);
+    void PatchJump(int pos);
+    void PatchJumps(const std::vector<int>& list);
+    void EmitThrow(const std::string& msg);
+    int AddConst(const Value& val);
+    int AddVar(Symbol name);
+    void EnterScope(VMContext::Type type, const InstructionList& body);
+    void LeaveScope();
+    void CollectDeclarations(const Instruction* ins, std::vector<Symbol>& names);
+    int AddFunction(const Instruction* func);
+    ByteCode* NewByteCode(Symbol name, const Instruction* source);
+
+protected:
+    const Script* mScript;
+    std::vector<ByteCode*>& mHolder;
+    ByteCode* mCode;
+    bool mInFunction;
+    std::vector<BreakableScope> mBreakable;
+    std::vector<int> mScopes;
+};
+
+} // namespace Interpreter
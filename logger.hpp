@@ -1,5 +1,24 @@
 #pragma once
 
-#include <iostream>
+#include <stdio.h>
 
-#define LOG(msg)  (std::cout<<__FUNCTION__<<":"<<__LINE__<<"\t"<<msg<<std::endl) 
\ No newline at end of file
+#include <sstream>
+#include <string>
+
+//LOG,parse errors and other diagnostics of a thread go here,stdout unless a batch
+//job captures what its worker prints
+inline FILE*& ThreadLogOutput() {
+    static thread_local FILE* output = stdout;
+    return output;
+}
+
+inline void LogWrite(const std::string& text) {
+    fwrite(text.data(), 1, text.size(), ThreadLogOutput());
+}
+
+#define LOG(msg)                                                             \
+    do {                                                                     \
+        std::stringstream _log;                                              \
+        _log << __FUNCTION__ << ":" << __LINE__ << "\t" << msg << std::endl; \
+        LogWrite(_log.str());                                                \
+    } while (0)
@@ -1,15 +1,26 @@
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <fstream>
+#include <thread>
+#include <vector>
 
 
+#include "optimizer.hpp"
 #include "parser.hpp"
+#include "scriptcache.hpp"
 #include "vm.hpp"
 using namespace Interpreter;
 #include "script.lex.hpp"
 #include "script.tab.hpp"
 void yyerror(Interpreter::Parser* parser, const char* s) {
-    printf("%s on line:%d\n", s, yylineno);
+    fprintf(ThreadLogOutput(), "%s on line:%d\n", s, yyget_lineno(parser->GetScanner()));
 }
 
 char* read_file_content(const char* path, int* file_size) {
@@ -40,9 +51,11 @@ char* read_file_content(const char* path, int* file_size) {
     return content;
 }
 
-
+//print the instruction count of every script before and after optimize
+static bool g_dumpOptimize = false;
 
 scoped_refptr<Script> ParserFile(std::string path) {
+    yyscan_t scanner;
     YY_BUFFER_STATE bp;
     char* context;
     int file_size;
@@ -50,39 +63,325 @@ scoped_refptr<Script> ParserFile(std::string path) {
     if (context == NULL) {
         return NULL;
     }
+    if (yylex_init(&scanner) != 0) {
+        free(context);
+        return NULL;
+    }
     scoped_refptr<Parser> parser = make_scoped_refptr(new Parser());
-    bp = yy_scan_buffer(context, file_size + 2);
-    yy_switch_to_buffer(bp);
+    bp = yy_scan_buffer(context, file_size + 2, scanner);
+    parser->SetScanner(scanner);
     parser->Start(split(path,'/').back());
     int error = yyparse(parser.get());
-    yy_flush_buffer(bp);
-    yy_delete_buffer(bp);
-    yylex_destroy();
+    parser->SetScanner(NULL);
+    yy_delete_buffer(bp, scanner);
+    yylex_destroy(scanner);
     free(context);
     if (error) {
         return NULL;
     }
-    return parser->Finish();
+    scoped_refptr<Script> script = parser->Finish();
+    Optimizer optimizer(script.get());
+    int before = g_dumpOptimize ? optimizer.CountInstructions() : 0;
+    optimizer.Optimize();
+    if (g_dumpOptimize) {
+        fprintf(stderr, "optimize %s: %d instructions before, %d after\n", script->Name.c_str(),
+                before, optimizer.CountInstructions());
+    }
+    return script;
+}
+
+//load a script written by --compile,the file is mapped and read in place
+scoped_refptr<Script> LoadCompiledFile(const std::string& path, const std::string& name) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    scoped_refptr<Script> script = new Script(name);
+    try {
+        ScriptReader reader((const char*)data, info.st_size);
+        script->ReadFromStream(reader);
+    } catch (const RuntimeException& e) {
+        fprintf(stderr, "load %s failed:%s\n", path.c_str(), e.what());
+        script = NULL;
+    }
+    munmap(data, info.st_size);
+    return script;
 }
 
+static bool HasSuffix(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//a .osc file is loaded as compiled,a .sc file is replaced by the .osc beside it
+//when that one is newer than the source.loadedPath is set to the file read
+scoped_refptr<Script> LoadScriptFile(const std::string& path, std::string* loadedPath) {
+    std::string name = split(path, '/').back();
+    if (loadedPath != NULL) {
+        *loadedPath = path;
+    }
+    if (HasSuffix(path, ".osc")) {
+        return LoadCompiledFile(path, name);
+    }
+    if (HasSuffix(path, ".sc")) {
+        std::string compiled = path.substr(0, path.size() - 3) + ".osc";
+        struct stat source, target;
+        if (stat(path.c_str(), &source) == 0 && stat(compiled.c_str(), &target) == 0 &&
+            target.st_mtime > source.st_mtime) {
+            scoped_refptr<Script> script = LoadCompiledFile(compiled, name);
+            if (script != NULL) {
+                if (loadedPath != NULL) {
+                    *loadedPath = compiled;
+                }
+                return script;
+            }
+        }
+    }
+    return ParserFile(path);
+}
+
+int CompileFile(const std::string& path, const std::string& output) {
+    scoped_refptr<Script> script = ParserFile(path);
+    if (script == NULL) {
+        return -1;
+    }
+    std::ofstream o(output.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    try {
+        script->WriteToStream(o);
+    } catch (const RuntimeException& e) {
+        fprintf(stderr, "compile %s failed:%s\n", path.c_str(), e.what());
+        return -1;
+    }
+    o.close();
+    if (!o) {
+        fprintf(stderr, "write %s failed\n", output.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+//parse the file on several threads at once and check every thread got the same
+//instructions as a parse on this thread
+int VerifyParse(const std::string& path, int threads) {
+    scoped_refptr<Script> expect = ParserFile(path);
+    if (expect == NULL) {
+        return -1;
+    }
+    std::string dump = expect->DumpInstruction(expect->EntryPoint, "");
+    std::vector<std::string> dumps(threads);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(std::thread([&path, &dumps, i]() {
+            scoped_refptr<Script> script = ParserFile(path);
+            if (script != NULL) {
+                dumps[i] = script->DumpInstruction(script->EntryPoint, "");
+            }
+        }));
+    }
+    int mismatch = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].join();
+        if (dumps[i] != dump) {
+            mismatch++;
+        }
+    }
+    printf("parse %s on %d threads:%d mismatch\n", path.c_str(), threads, mismatch);
+    return mismatch == 0 ? 0 : -1;
+}
+
+//required libraries are parsed once for all executors
+static ScriptCache g_scriptCache(LoadScriptFile);
+
 class DefaultExecutorCallback : public ExecutorCallback {
 protected:
     std::string mFolder;
 
 public:
     DefaultExecutorCallback(const std::string& folder) : mFolder(folder) {}
+    void SetFolder(const std::string& folder) { mFolder = folder; }
     scoped_refptr<Script> LoadScript(const char* name) {
         std::string path = mFolder + name;
-        return ParserFile(path);
+        return g_scriptCache.Load(path);
     }
 };
 
+//required scripts are looked up beside the script which requires them
+static std::string FolderOf(const std::string& path) {
+    return path.substr(0, path.rfind('/') + 1);
+}
+
+//a script of a batch run and what it printed
+struct BatchJob {
+    std::string Path;
+    std::string Output;
+    std::string Error;
+    bool Passed;
+};
+
+//run one job on the executor of a worker.what the script prints,and what this thread
+//logs while loading and running it (parse errors,warnings),is kept in the job
+static void RunJob(Executor& exe, BatchJob& job) {
+    job.Passed = false;
+    char* buffer = NULL;
+    size_t size = 0;
+    FILE* output = open_memstream(&buffer, &size);
+    if (output == NULL) {
+        job.Error = "create output stream failed";
+        return;
+    }
+    ThreadLogOutput() = output;
+    scoped_refptr<Script> script = g_scriptCache.Load(job.Path);
+    if (script == NULL) {
+        job.Error = "load script failed";
+    } else {
+        exe.SetOutput(output);
+        job.Passed = exe.Execute(script, job.Error, false);
+        exe.SetOutput(stdout);
+    }
+    ThreadLogOutput() = stdout;
+    fclose(output);
+    job.Output.assign(buffer, size);
+    free(buffer);
+}
+
+//run the jobs on a pool of workers,every worker has its own executor and the parsed
+//scripts are shared through g_scriptCache.the outputs are printed in the job order
+//once all jobs finished
+int RunBatch(std::vector<BatchJob>& jobs, int workers) {
+    if ((size_t)workers > jobs.size()) {
+        workers = jobs.size();
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; i++) {
+        pool.push_back(std::thread([&jobs, &next]() {
+            DefaultExecutorCallback callback("");
+            Executor exe(&callback);
+            for (size_t index = next++; index < jobs.size(); index = next++) {
+                callback.SetFolder(FolderOf(jobs[index].Path));
+                RunJob(exe, jobs[index]);
+            }
+        }));
+    }
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        printf("==> %s <==\n", jobs[i].Path.c_str());
+        fwrite(jobs[i].Output.data(), 1, jobs[i].Output.size(), stdout);
+        if (!jobs[i].Passed) {
+            //stderr is unbuffered,what was printed so far goes first
+            fflush(stdout);
+            fprintf(stderr, "%s execute error:%s\n", jobs[i].Path.c_str(),
+                    jobs[i].Error.c_str());
+            failed++;
+        }
+    }
+    printf("%d of %d scripts failed\n", failed, (int)jobs.size());
+    return failed == 0 ? 0 : -1;
+}
+
+//a manifest lists one script per line,empty lines and lines starting with # are skipped
+static bool ReadManifest(const std::string& path, std::vector<BatchJob>& jobs) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        fprintf(stderr, "open manifest %s failed\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.size() > 0 && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        BatchJob job;
+        job.Path = line;
+        job.Passed = false;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    std::string folder = argv[1];
-    folder = folder.substr(0, folder.rfind('/') + 1);
-    scoped_refptr<Script> script = ParserFile(argv[1]);
+    const char* path = NULL;
+    const char* output = NULL;
+    const char* manifest = NULL;
+    bool compile = false;
+    int verifyThreads = 0;
+    int jobCount = 0;
+    std::vector<BatchJob> jobs;
+    //a TLS write to a server which closed the connection must fail,not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dump-optimize") == 0) {
+            g_dumpOptimize = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--compile") == 0) {
+            compile = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--verify-parse") == 0 && i + 1 < argc) {
+            verifyThreads = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobCount = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+            continue;
+        }
+        path = argv[i];
+        BatchJob job;
+        job.Path = path;
+        job.Passed = false;
+        jobs.push_back(job);
+    }
+    if (jobCount > 0 || manifest != NULL) {
+        if (manifest != NULL && !ReadManifest(manifest, jobs)) {
+            return -1;
+        }
+        if (jobs.empty()) {
+            fprintf(stderr, "no script to run\n");
+            return -1;
+        }
+        return RunBatch(jobs, jobCount > 0 ? jobCount : 1);
+    }
+    if (path == NULL || (compile && output == NULL)) {
+        fprintf(stderr, "usage: %s [--dump-optimize] script\n", argv[0]);
+        fprintf(stderr, "       %s --compile script -o output.osc\n", argv[0]);
+        fprintf(stderr, "       %s --verify-parse threads script\n", argv[0]);
+        fprintf(stderr, "       %s --jobs N [--manifest file] script...\n", argv[0]);
+        return -1;
+    }
+    if (verifyThreads > 0) {
+        return VerifyParse(path, verifyThreads);
+    }
+    if (compile) {
+        return CompileFile(path, output);
+    }
+    scoped_refptr<Script> script = LoadScriptFile(path, NULL);
     if (script != NULL) {
-        DefaultExecutorCallback callback(folder);
+        DefaultExecutorCallback callback(FolderOf(path));
         Executor exe(&callback);
         std::string err = "";
         //std::cout << script->DumpInstruction(script->EntryPoint,"")<<std::endl;
@@ -8,31 +8,31 @@ Value ContainsBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    return Value(args[0].bytes.find(args[1].bytes) != std::string::npos);
+    return Value(args[0].Bytes().find(args[1].Bytes()) != std::string::npos);
 }
 
 Value HasPrefixBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    return Value(args[0].bytes.find(args[1].bytes) == 0);
+    return Value(args[0].Bytes().find(args[1].Bytes()) == 0);
 }
 
 Value HasSuffixBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    if (args[0].bytes.size() < args[1].bytes.size()) {
+    if (args[0].Bytes().size() < args[1].Bytes().size()) {
         return Value(false);
     }
-    int pos = args[0].bytes.size() - args[1].bytes.size();
-    if (args[0].bytes.substr(pos) == args[1].bytes) {
+    int pos = args[0].Bytes().size() - args[1].Bytes().size();
+    if (args[0].Bytes().substr(pos) == args[1].Bytes()) {
         return Value(true);
     }
     return Value(false);
 }
 
-bool ContainsByte(std::string& str, unsigned char c) {
+bool ContainsByte(const std::string& str, unsigned char c) {
     return str.find(c) != std::string::npos;
 }
 
@@ -41,15 +41,15 @@ Value TrimLeftBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
     size_t pos = 0;
-    for (size_t i = 0; i < args[0].bytes.size(); i++) {
-        if (ContainsByte(args[1].bytes, args[0].bytes[i])) {
+    for (size_t i = 0; i < args[0].Bytes().size(); i++) {
+        if (ContainsByte(args[1].Bytes(), args[0].Bytes()[i])) {
             pos = i + 1;
             continue;
         }
         break;
     }
-    if (pos < args[0].bytes.size()) {
-        Value ret = Value::make_bytes(args[0].bytes.substr(pos));
+    if (pos < args[0].Bytes().size()) {
+        Value ret = Value::make_bytes(args[0].Bytes().substr(pos));
         ret.Type = args[0].Type;
         return ret;
     }
@@ -62,18 +62,18 @@ Value TrimRightBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    if (args[0].bytes.size() == 0) {
+    if (args[0].Bytes().size() == 0) {
         return Value("");
     }
-    size_t length = args[0].bytes.size();
-    for (size_t i = args[0].bytes.size() - 1; i >= 0; i--) {
-        if (ContainsByte(args[1].bytes, args[0].bytes[i])) {
+    size_t length = args[0].Bytes().size();
+    for (size_t i = args[0].Bytes().size() - 1; i >= 0; i--) {
+        if (ContainsByte(args[1].Bytes(), args[0].Bytes()[i])) {
             length = i;
             continue;
         }
         break;
     }
-    Value ret = Value::make_bytes(args[0].bytes.substr(0, length));
+    Value ret = Value::make_bytes(args[0].Bytes().substr(0, length));
     ret.Type = args[0].Type;
     return ret;
 }
@@ -83,16 +83,16 @@ Value TrimBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
     size_t pos = 0;
-    for (size_t i = 0; i < args[0].bytes.size(); i++) {
-        if (ContainsByte(args[1].bytes, args[0].bytes[i])) {
+    for (size_t i = 0; i < args[0].Bytes().size(); i++) {
+        if (ContainsByte(args[1].Bytes(), args[0].Bytes()[i])) {
             pos = i + 1;
             continue;
         }
         break;
     }
-    size_t end = args[0].bytes.size() - 1;
-    for (size_t i = args[0].bytes.size() - 1; i >= 0; i--) {
-        if (ContainsByte(args[1].bytes, args[0].bytes[i])) {
+    size_t end = args[0].Bytes().size() - 1;
+    for (size_t i = args[0].Bytes().size() - 1; i >= 0; i--) {
+        if (ContainsByte(args[1].Bytes(), args[0].Bytes()[i])) {
             end = i;
             continue;
         }
@@ -103,7 +103,7 @@ Value TrimBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     if (pos > end) {
         return ret;
     }
-    ret.bytes = args[0].bytes.substr(pos, end - pos);
+    ret.MutableBytes() = args[0].Bytes().substr(pos, end - pos);
     return ret;
 }
 
@@ -111,7 +111,7 @@ Value IndexBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    size_t pos = args[0].bytes.find(args[1].bytes);
+    size_t pos = args[0].Bytes().find(args[1].Bytes());
     return Value((long)pos);
 }
 
@@ -119,7 +119,7 @@ Value LastIndexBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    size_t pos = args[0].bytes.rfind(args[1].bytes);
+    size_t pos = args[0].Bytes().rfind(args[1].Bytes());
     return Value((long)pos);
 }
 
@@ -129,7 +129,7 @@ Value RepeatBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_INTEGER(1);
     std::string result = "";
     for (size_t i = 0; i < args[1].Integer; i++) {
-        result.append(args[0].bytes);
+        result.append(args[0].Bytes());
     }
     Value ret = Value::make_bytes(result);
     ret.Type = args[0].Type;
@@ -160,11 +160,11 @@ Value ReplaceBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(1);
     CHECK_PARAMETER_STRING(2);
     CHECK_PARAMETER_INTEGER(3);
-    std::string result = args[0].bytes;
-    result = replace_str(result, args[1].bytes, args[2].bytes, (int)args[3].Integer);
+    std::string result = args[0].Bytes();
+    result = replace_str(result, args[1].Bytes(), args[2].Bytes(), (int)args[3].Integer);
     Value ret = Value::make_bytes(result);
     ret.Type = args[0].Type;
-    ret.bytes = result;
+    ret.MutableBytes() = result;
     return ret;
 }
 
@@ -173,15 +173,15 @@ Value ReplaceAllBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
     CHECK_PARAMETER_STRING(2);
-    std::string result = args[0].bytes;
-    result = replace_str(result, args[1].bytes, args[2].bytes, -1);
+    std::string result = args[0].Bytes();
+    result = replace_str(result, args[1].Bytes(), args[2].Bytes(), -1);
     Value ret = Value::make_bytes(result);
     ret.Type = args[0].Type;
-    ret.bytes = result;
+    ret.MutableBytes() = result;
     return ret;
 }
 
-std::vector<Value> Split(std::string& src, std::string& slip) {
+std::vector<Value> Split(const std::string& src, const std::string& slip) {
     size_t i = std::string::npos;
     std::string part = src;
     std::vector<Value> result;
@@ -204,7 +204,7 @@ Value SplitBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_STRING(0);
     CHECK_PARAMETER_STRING(1);
-    std::vector<Value> result = Split(args[0].bytes, args[1].bytes);
+    std::vector<Value> result = Split(args[0].Bytes(), args[1].Bytes());
     std::vector<Value>::iterator iter = result.begin();
     while (iter != result.end()) {
         iter->Type = args[1].Type;
@@ -216,14 +216,16 @@ Value SplitBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
 Value ToUpperBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
-    transform(args[0].bytes.begin(), args[0].bytes.end(), args[0].bytes.begin(), toupper);
+    std::string& data = args[0].MutableBytes();
+    transform(data.begin(), data.end(), data.begin(), toupper);
     return args[0];
 }
 
 Value ToLowerBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
-    transform(args[0].bytes.begin(), args[0].bytes.end(), args[0].bytes.begin(), tolower);
+    std::string& data = args[0].MutableBytes();
+    transform(data.begin(), data.end(), data.begin(), tolower);
     return args[0];
 }
 
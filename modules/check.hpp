@@ -36,7 +36,7 @@ inline std::string check_error(int i, const char* type) {
     }
 
 #define CHECK_PARAMETER_ARRAY(i)                                                     \
-    if (args[i].Type != ValueType::kMap) {                                           \
+    if (args[i].Type != ValueType::kArray) {                                         \
         throw RuntimeException(std::string(__FUNCTION__) + check_error(i, "array")); \
     }
 #endif
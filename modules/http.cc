@@ -17,6 +17,157 @@ struct HeaderValue {
     std::string Value;
 };
 
+//receives a body piece by piece as it's decoded
+class BodySink {
+public:
+    virtual ~BodySink() {}
+    //false stops reading the body
+    virtual bool Write(const char* data, size_t size) = 0;
+};
+
+class StringSink : public BodySink {
+public:
+    explicit StringSink(std::string& out) : mOut(out) {}
+    bool Write(const char* data, size_t size) {
+        mOut.append(data, size);
+        return true;
+    }
+
+private:
+    std::string& mOut;
+};
+
+//decodes a body by its Content-Encoding (gzip,deflate or br) while it's fed,the decoded
+//bytes go to the sink through one fixed buffer.maxSize caps the decoded size,0 for none
+class BodyDecoder {
+public:
+    BodyDecoder(BodySink* sink, size_t maxSize)
+            : mSink(sink),
+              mMaxSize(maxSize),
+              mDecoded(0),
+              mEncoding(kIdentity),
+              mBrotli(NULL),
+              mFed(false),
+              mEnded(false) {
+        memset(&mZlib, 0, sizeof(mZlib));
+    }
+    ~BodyDecoder() {
+        if (mEncoding == kZlib) {
+            inflateEnd(&mZlib);
+        }
+        if (mBrotli) {
+            BrotliDecoderDestroyInstance(mBrotli);
+        }
+    }
+    //an encoding which isn't known is passed through
+    bool Start(const std::string& contentEncoding) {
+        if (contentEncoding.find("gzip") != std::string::npos ||
+            contentEncoding.find("deflate") != std::string::npos) {
+            //32 detects a gzip or zlib header
+            if (inflateInit2(&mZlib, 32 + 15) != Z_OK) {
+                return false;
+            }
+            mEncoding = kZlib;
+        } else if (contentEncoding.find("br") != std::string::npos) {
+            mBrotli = BrotliDecoderCreateInstance(0, 0, 0);
+            if (mBrotli == NULL) {
+                return false;
+            }
+            mEncoding = kBrotli;
+        }
+        return true;
+    }
+    bool Feed(const char* data, size_t size) {
+        mFed = mFed || size > 0;
+        switch (mEncoding) {
+        case kZlib:
+            return FeedZlib(data, size);
+        case kBrotli:
+            return FeedBrotli(data, size);
+        default:
+            return Emit(data, size);
+        }
+    }
+    //false when a compressed body was cut before its end
+    bool Finish() { return mEncoding == kIdentity || !mFed || mEnded; }
+    size_t DecodedSize() const { return mDecoded; }
+    const std::string& Error() const { return mError; }
+
+protected:
+    enum Encoding { kIdentity, kZlib, kBrotli };
+    bool Emit(const char* data, size_t size) {
+        if (size == 0) {
+            return true;
+        }
+        mDecoded += size;
+        if (mMaxSize != 0 && mDecoded > mMaxSize) {
+            mError = "body is larger than the limit";
+            return false;
+        }
+        if (!mSink->Write(data, size)) {
+            mError = "body sink stopped";
+            return false;
+        }
+        return true;
+    }
+    bool FeedZlib(const char* data, size_t size) {
+        mZlib.next_in = (Bytef*)data;
+        mZlib.avail_in = size;
+        //a full output buffer may leave more output behind even when the input is used up
+        while (!mEnded && (mZlib.avail_in > 0 || mZlib.avail_out == 0)) {
+            mZlib.next_out = (Bytef*)mBuffer.data();
+            mZlib.avail_out = mBuffer.size();
+            int ret = inflate(&mZlib, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                mError = "inflate body failed";
+                return false;
+            }
+            if (!Emit(mBuffer.data(), mBuffer.size() - mZlib.avail_out)) {
+                return false;
+            }
+            mEnded = (ret == Z_STREAM_END);
+            if (ret == Z_BUF_ERROR) {
+                break;
+            }
+        }
+        return true;
+    }
+    bool FeedBrotli(const char* data, size_t size) {
+        const uint8_t* next_in = (const uint8_t*)data;
+        size_t avail_in = size;
+        while (!mEnded) {
+            uint8_t* next_out = (uint8_t*)mBuffer.data();
+            size_t avail_out = mBuffer.size();
+            BrotliDecoderResult result = BrotliDecoderDecompressStream(
+                    mBrotli, &avail_in, &next_in, &avail_out, &next_out, NULL);
+            if (result == BROTLI_DECODER_RESULT_ERROR) {
+                mError = "brotli body failed";
+                return false;
+            }
+            if (!Emit(mBuffer.data(), mBuffer.size() - avail_out)) {
+                return false;
+            }
+            mEnded = (result == BROTLI_DECODER_RESULT_SUCCESS);
+            if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+                break;
+            }
+        }
+        return true;
+    }
+
+private:
+    BodySink* mSink;
+    size_t mMaxSize;
+    size_t mDecoded;
+    Encoding mEncoding;
+    z_stream mZlib;
+    BrotliDecoderState* mBrotli;
+    bool mFed;
+    bool mEnded;
+    std::string mError;
+    std::array<char, 8192> mBuffer;
+};
+
 class HTTPResponse {
 public:
     static const int kFIELD = 2;
@@ -33,13 +184,18 @@ public:
               Reason(""),
               Body(""),
               RawHeader(""),
-              Header() {}
+              Header(),
+              BodyWriter(Body),
+              Sink(NULL),
+              MaxBodySize(0),
+              Decoder(NULL) {}
     ~HTTPResponse() {
         auto iter = Header.begin();
         while (iter != Header.end()) {
             delete *iter;
             iter++;
         }
+        delete Decoder;
     }
     std::string Version;
     std::string Status;
@@ -54,7 +210,8 @@ public:
         ret._map()["status"] = Value(strtol(Status.c_str(), NULL, 0));
         ret._map()["reason"] = Reason;
         ret._map()["raw_header"] = RawHeader;
-        ret._map()["body"] = Value::make_bytes(Body);
+        //the body is moved into the value,the response is done with once it's converted
+        ret._map()["body"] = Value::make_bytes(std::move(Body));
         Value h = Value::make_map();
         std::vector<HeaderValue*>::iterator iter = Header.begin();
         while (iter != Header.end()) {
@@ -76,6 +233,14 @@ public:
     bool IsHeadCompleteCalled;
     bool IsMessageCompleteCalled;
     int64_t ChunkedTotalBodySize;
+    //appends the decoded body to Body
+    StringSink BodyWriter;
+    //where the decoded body goes,NULL for BodyWriter
+    BodySink* Sink;
+    //0 for no limit
+    size_t MaxBodySize;
+    //created when the headers are complete
+    BodyDecoder* Decoder;
 
 public:
     std::string GetHeaderValue(std::string name) {
@@ -147,7 +312,11 @@ int header_value_cb(http_parser* p, const char* buf, size_t len) {
 int headers_complete_cb(http_parser* p) {
     HTTPResponse* resp = (HTTPResponse*)p->data;
     resp->IsHeadCompleteCalled = true;
-    return 0;
+    delete resp->Decoder;
+    resp->Decoder = NULL;
+    BodySink* sink = resp->Sink ? resp->Sink : &resp->BodyWriter;
+    resp->Decoder = new BodyDecoder(sink, resp->MaxBodySize);
+    return resp->Decoder->Start(resp->GetHeaderValue("Content-Encoding")) ? 0 : -1;
 }
 
 int on_chunk_header(http_parser* p) {
@@ -158,8 +327,10 @@ int on_chunk_header(http_parser* p) {
 
 int on_body_cb(http_parser* p, const char* buf, size_t len) {
     HTTPResponse* resp = (HTTPResponse*)p->data;
-    resp->Body.append(buf, len);
-    return 0;
+    if (resp->Decoder == NULL) {
+        return -1;
+    }
+    return resp->Decoder->Feed(buf, len) ? 0 : -1;
 }
 
 int on_message_complete_cb(http_parser* p) {
@@ -168,58 +339,19 @@ int on_message_complete_cb(http_parser* p) {
     return 0;
 }
 
-bool DeflateStream(std::string& src, std::string& out) {
-    z_stream strm = {0};
-    inflateInit2(&strm, 32 + 15);
-    size_t process_size = 0;
-    Bytef* data = (Bytef*)src.c_str();
-
-    int ret = Z_OK;
-    strm.avail_in = src.size();
-    strm.next_in = data;
-    std::array<char, 8192> buffer {};
-    while (strm.avail_in > 0) {
-        strm.avail_out = buffer.size();
-        strm.next_out = (Bytef*)buffer.data();
-        ret = inflate(&strm, Z_NO_FLUSH);
-        assert(ret != Z_STREAM_ERROR);
-        switch (ret) {
-        case Z_NEED_DICT:
-        case Z_DATA_ERROR:
-        case Z_MEM_ERROR:
-            inflateEnd(&strm);
-            return false;
-        }
-        out.append(buffer.data(), buffer.size() - strm.avail_out);
-    }
-    inflateEnd(&strm);
-    return true;
+bool DecodeBody(const std::string& encoding, const std::string& src, std::string& out) {
+    StringSink sink(out);
+    BodyDecoder decoder(&sink, 0);
+    return decoder.Start(encoding) && decoder.Feed(src.data(), src.size()) && decoder.Finish();
 }
 
-bool BrotliDecompress(std::string& src, std::string& out) {
-    BrotliDecoderResult result;
-    BrotliDecoderState* state = BrotliDecoderCreateInstance(0, 0, 0);
-    if (state == NULL) {
-        return false;
-    }
-    const unsigned char* next_in = (const unsigned char*)src.c_str();
-    size_t avail_in = src.size();
-    size_t total_out = 0;
-    std::array<char, 8192> buffer {};
+bool DeflateStream(const std::string& src, std::string& out) {
+    return DecodeBody("gzip", src, out);
+}
 
-    result = BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT;
+bool BrotliDecompress(const std::string& src, std::string& out) {
     out.clear();
-    while (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) {
-        char* next_out = buffer.data();
-        size_t avail_out = buffer.size();
-
-        result = BrotliDecoderDecompressStream(state, &avail_in, &next_in, &avail_out,
-                                               reinterpret_cast<uint8_t**>(&next_out), &total_out);
-
-        out.append(next_out, total_out);
-    }
-    BrotliDecoderDestroyInstance(state);
-    return result == BROTLI_DECODER_RESULT_SUCCESS;
+    return DecodeBody("br", src, out);
 }
 
 struct StreamSearch {
@@ -241,7 +373,9 @@ struct StreamSearch {
     }
 };
 
-bool DoReadHttpResponse(scoped_refptr<TCPStream> stream, HTTPResponse* resp) {
+//keepAlive is set when the stream can carry another request after this response
+bool DoReadHttpResponse(scoped_refptr<TCPStream> stream, HTTPResponse* resp,
+                        bool* keepAlive = NULL) {
     StreamSearch search("\r\n\r\n");
     http_parser parser;
     http_parser_init(&parser, HTTP_RESPONSE);
@@ -275,40 +409,184 @@ bool DoReadHttpResponse(scoped_refptr<TCPStream> stream, HTTPResponse* resp) {
             return false;
         }
         if (resp->IsMessageCompleteCalled) {
+            if (keepAlive) {
+                *keepAlive = http_should_keep_alive(&parser) != 0 && size > 0 &&
+                             parse_size == size;
+            }
             break;
         }
-    }
-    std::string encoding = resp->GetHeaderValue("Content-Encoding");
-    if (-1 != encoding.find("gzip") || -1 != encoding.find("deflate")) {
-        std::string out = "";
-        if (!DeflateStream(resp->Body, out)) {
+        //the peer closed the stream before the message completed
+        if (size == 0) {
             return false;
         }
-        resp->Body = out;
-        return true;
     }
-    if (-1 != encoding.find("br")) {
-        std::string out = "";
-        if (!BrotliDecompress(resp->Body, out)) {
-            return false;
+    //the decoder saw the whole body,a cut compressed body is an error
+    return resp->Decoder == NULL || resp->Decoder->Finish();
+}
+
+//idle keep-alive connections of an executor,keyed by scheme://host:port.
+//only the executor's thread uses it
+class HTTPConnectionPool : public Resource {
+public:
+    HTTPConnectionPool()
+            : mMaxIdle(16), mMaxPerHost(4), mIdleTimeout(30), mOpened(0), mReused(0) {}
+    static HTTPConnectionPool* Of(Executor* vm) {
+        HTTPConnectionPool* pool = (HTTPConnectionPool*)vm->GetModuleData("http.pool");
+        if (pool == NULL) {
+            pool = new HTTPConnectionPool();
+            vm->SetModuleData("http.pool", pool);
         }
-        resp->Body = out;
-        return true;
+        return pool;
     }
-    return true;
-}
+    void Close() {
+        while (!mIdle.empty()) {
+            Drop(mIdle.begin());
+        }
+    }
+    bool IsAvaliable() { return true; }
+    std::string TypeName() { return "HTTPConnectionPool"; }
 
-bool DoHttpRequest(std::string& host, std::string& port, bool isSSL, std::string& req,
-                   HTTPResponse* resp) {
-    scoped_refptr<TCPStream> tcp = NewTCPStream(host, port, 60, isSSL);
-    if (tcp.get() == NULL) {
-        return false;
+    //the newest idle connection which is still usable,NULL when there is none
+    scoped_refptr<TCPStream> Take(const std::string& key) {
+        int64_t now = monotonic_milliseconds();
+        std::list<IdleConnection>::iterator iter = mIdle.end();
+        while (iter != mIdle.begin()) {
+            iter--;
+            if (iter->Key != key) {
+                continue;
+            }
+            scoped_refptr<TCPStream> stream = iter->Stream;
+            int64_t since = iter->Since;
+            iter = mIdle.erase(iter);
+            if (now - since < (int64_t)mIdleTimeout * 1000 && !IsStale(stream.get())) {
+                mReused++;
+                return stream;
+            }
+            stream->Close();
+        }
+        return NULL;
     }
-    int size = tcp->Send(req.c_str(), req.size());
-    if (size != req.size()) {
-        return false;
+    void Put(const std::string& key, scoped_refptr<TCPStream> stream) {
+        if (mMaxIdle == 0 || mMaxPerHost == 0) {
+            stream->Close();
+            return;
+        }
+        size_t count = 0;
+        std::list<IdleConnection>::iterator oldest = mIdle.end();
+        for (std::list<IdleConnection>::iterator iter = mIdle.begin(); iter != mIdle.end();
+             iter++) {
+            if (iter->Key == key) {
+                if (count == 0) {
+                    oldest = iter;
+                }
+                count++;
+            }
+        }
+        if (count >= mMaxPerHost) {
+            Drop(oldest);
+        } else if (mIdle.size() >= mMaxIdle) {
+            Drop(mIdle.begin());
+        }
+        IdleConnection idle = {key, stream, monotonic_milliseconds()};
+        mIdle.push_back(idle);
+    }
+    void ConnectionOpened() { mOpened++; }
+    void SetLimits(size_t maxIdle, size_t maxPerHost, int idleTimeout) {
+        mMaxIdle = maxIdle;
+        mMaxPerHost = maxPerHost;
+        mIdleTimeout = idleTimeout;
+        while (mIdle.size() > mMaxIdle) {
+            Drop(mIdle.begin());
+        }
+    }
+    Value Stats() {
+        Value ret = Value::make_map();
+        ret._map()["opened"] = Value(mOpened);
+        ret._map()["reused"] = Value(mReused);
+        ret._map()["idle"] = Value(mIdle.size());
+        return ret;
+    }
+
+protected:
+    struct IdleConnection {
+        std::string Key;
+        scoped_refptr<TCPStream> Stream;
+        int64_t Since;
+    };
+    //the socket of a dropped connection is closed now,not when its last reference goes
+    void Drop(std::list<IdleConnection>::iterator iter) {
+        iter->Stream->Close();
+        mIdle.erase(iter);
+    }
+    //an idle connection has nothing to read,a readable one was closed by the server
+    //(or sent data nobody asked for).on TLS that includes a record openssl already
+    //decrypted and a close_notify still in the socket,any byte of either makes it stale
+    static bool IsStale(TCPStream* stream) {
+        if (!stream->IsAvaliable()) {
+            return true;
+        }
+        if (stream->mSSL != NULL && SSL_pending(stream->mSSL) > 0) {
+            return true;
+        }
+        struct pollfd pfd;
+        pfd.fd = stream->mSocket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, 0) != 0;
+    }
+
+protected:
+    //oldest first
+    std::list<IdleConnection> mIdle;
+    size_t mMaxIdle;
+    size_t mMaxPerHost;
+    int mIdleTimeout;
+    int64_t mOpened;
+    int64_t mReused;
+};
+
+//a request which may be sent twice without changing the result (RFC 7231 4.2.2)
+static bool IsIdempotentRequest(const std::string& req) {
+    static const char* methods[] = {"GET ", "HEAD ", "OPTIONS ", "TRACE ", "PUT ", "DELETE "};
+    for (size_t i = 0; i < COUNT_OF(methods); i++) {
+        if (req.compare(0, strlen(methods[i]), methods[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DoHttpRequest(Executor* vm, std::string& host, std::string& port, bool isSSL,
+                   std::string& req, HTTPResponse* resp) {
+    HTTPConnectionPool* pool = HTTPConnectionPool::Of(vm);
+    std::string key = (isSSL ? "https://" : "http://") + host + ":" + port;
+    scoped_refptr<TCPStream> tcp = pool->Take(key);
+    bool reused = tcp.get() != NULL;
+    while (true) {
+        if (tcp.get() == NULL) {
+            tcp = NewTCPStream(host, port, 60, isSSL);
+            if (tcp.get() == NULL) {
+                return false;
+            }
+            pool->ConnectionOpened();
+        }
+        bool keepAlive = false;
+        int size = tcp->Send(req.c_str(), req.size());
+        if (size == (int)req.size() && DoReadHttpResponse(tcp, resp, &keepAlive)) {
+            if (keepAlive) {
+                pool->Put(key, tcp);
+            }
+            return true;
+        }
+        //the server may close a pooled connection while it's sent to,an idempotent
+        //request is sent again on a new connection when no response came back.others
+        //may have been carried out already and fail
+        if (!reused || !resp->RawHeader.empty() || !IsIdempotentRequest(req)) {
+            return false;
+        }
+        reused = false;
+        tcp = NULL;
     }
-    return DoReadHttpResponse(tcp, resp);
 }
 
 enum encoding {
@@ -483,7 +761,8 @@ bool unescape(const std::string s, std::string& t, encoding mode) {
     return true;
 }
 
-bool parser_querys(std::string& query, std::list<std::pair<std::string, std::string>>& result) {
+bool parser_querys(const std::string& query,
+                   std::list<std::pair<std::string, std::string>>& result) {
     std::list<std::string> pairs = split(query, '&');
     auto iter = pairs.begin();
     while (iter != pairs.end()) {
@@ -509,8 +788,8 @@ bool parser_querys(std::string& query, std::list<std::pair<std::string, std::str
     return true;
 }
 
-bool parser_url(std::string& url, std::string& scheme, std::string& host, std::string& port,
-                std::string& path, std::map<std::string, std::string>& querys) {
+bool parser_url(const std::string& url, std::string& scheme, std::string& host,
+                std::string& port, std::string& path, std::map<std::string, std::string>& querys) {
     std::string args = "";
     size_t i = url.find(":");
     if (i == std::string::npos) {
@@ -571,7 +850,7 @@ Value URLQueryUnescape(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
     std::string result = "";
-    if (!unescape(args[0].bytes, result, encodeQueryComponent)) {
+    if (!unescape(args[0].Bytes(), result, encodeQueryComponent)) {
         return Value();
     }
     return Value(result);
@@ -580,19 +859,19 @@ Value URLQueryUnescape(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
 Value URLQueryEscape(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
-    return Value(escape(args[0].bytes, encodeQueryComponent));
+    return Value(escape(args[0].Bytes(), encodeQueryComponent));
 }
 
 Value URLPathEscape(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
-    return Value(escape(args[0].bytes, encodePathSegment));
+    return Value(escape(args[0].Bytes(), encodePathSegment));
 }
 Value URLPathUnescape(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
     std::string result = "";
-    if (!unescape(args[0].bytes, result, encodePathSegment)) {
+    if (!unescape(args[0].Bytes(), result, encodePathSegment)) {
         return Value();
     }
     return Value(result);
@@ -603,7 +882,7 @@ Value URLQueryDecode(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     Value ret = Value::make_map();
     std::list<std::pair<std::string, std::string>> result;
-    if (parser_querys(args[0].bytes, result)) {
+    if (parser_querys(args[0].Bytes(), result)) {
         auto iter = result.begin();
         while (iter != result.end()) {
             ret._map()[iter->first] = iter->second;
@@ -640,7 +919,7 @@ Value URLQueryEncode(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
         if (result.size()) {
             result += "&";
         }
-        result += escape(iter->first.bytes, encodeQueryComponent);
+        result += escape(iter->first.Bytes(), encodeQueryComponent);
         result += "=";
         result += escape(iter->second.ToString(), encodeQueryComponent);
         iter++;
@@ -651,7 +930,7 @@ Value URLQueryEncode(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
 Value ReadHttpResponse(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_RESOURCE(0);
-    scoped_refptr<TCPStream> tcp = (TCPStream*)args[0].resource.get();
+    scoped_refptr<TCPStream> tcp = (TCPStream*)args[0].GetResource();
     HTTPResponse resp;
     if (DoReadHttpResponse(tcp, &resp)) {
         return resp.ToValue();
@@ -664,7 +943,7 @@ Value DeflateBytes(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     Value ret = Value::make_bytes("");
     ret.Type = args[0].Type;
-    DeflateStream(args[0].bytes, ret.bytes);
+    DeflateStream(args[0].Bytes(), ret.MutableBytes());
     return ret;
 }
 
@@ -673,7 +952,7 @@ Value BrotliDecompressBytes(std::vector<Value>& args, VMContext* ctx, Executor*
     CHECK_PARAMETER_STRING(0);
     Value ret = Value::make_bytes("");
     ret.Type = args[0].Type;
-    BrotliDecompress(args[0].bytes, ret.bytes);
+    BrotliDecompress(args[0].Bytes(), ret.MutableBytes());
     return ret;
 }
 
@@ -682,7 +961,7 @@ Value URLParse(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_STRING(0);
     std::string host, port, scheme, path;
     std::map<std::string, std::string> querys;
-    parser_url(args[0].bytes, scheme, host, port, path, querys);
+    parser_url(args[0].Bytes(), scheme, host, port, path, querys);
     Value ret = Value::make_map();
     ret._map()["host"] = host;
     ret._map()["port"] = port;
@@ -706,7 +985,7 @@ void BuildRequestHeader(Value val, std::string& forHost, std::string& port,
             if (iter->first.Type != ValueType::kString && iter->first.Type != ValueType::kBytes) {
                 throw RuntimeException("the httpheader map key must string or bytes");
             }
-            result[iter->first.bytes] = iter->second.ToString();
+            result[iter->first.Bytes()] = iter->second.ToString();
             iter++;
         }
     }
@@ -716,7 +995,7 @@ void BuildRequestHeader(Value val, std::string& forHost, std::string& port,
     }
     iter = result.find("Connection");
     if (iter == result.end()) {
-        result["Connection"] = "close";
+        result["Connection"] = "keep-alive";
     }
     iter = result.find("Host");
     if (iter == result.end()) {
@@ -728,18 +1007,13 @@ void BuildRequestHeader(Value val, std::string& forHost, std::string& port,
     }
 }
 
-Value HttpGet(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
-    CHECK_PARAMETER_COUNT(1);
-    CHECK_PARAMETER_STRING(0);
+//send a GET of the url with the headers (a map or nil),the response is read into resp
+bool DoHttpGet(Executor* vm, const std::string& url, Value header, HTTPResponse* resp) {
     std::map<std::string, std::string> headers;
     std::string host, port, scheme, path;
     std::map<std::string, std::string> querys;
-    parser_url(args[0].bytes, scheme, host, port, path, querys);
-    if (args.size() == 2 && args[1].Type == ValueType::kMap) {
-        BuildRequestHeader(args[1], host, port, headers);
-    } else {
-        BuildRequestHeader(Value(), host, port, headers);
-    }
+    parser_url(url, scheme, host, port, path, querys);
+    BuildRequestHeader(header, host, port, headers);
 
     std::stringstream o;
     o << "GET " << escape(path, encodePath);
@@ -754,13 +1028,116 @@ Value HttpGet(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     }
     o << "\r\n";
     std::string req = o.str();
+    return DoHttpRequest(vm, host, port, scheme == "https", req, resp);
+}
+
+Value HttpGet(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(1);
+    CHECK_PARAMETER_STRING(0);
+    Value header;
+    if (args.size() == 2 && args[1].Type == ValueType::kMap) {
+        header = args[1];
+    }
     HTTPResponse resp;
-    if (!DoHttpRequest(host, port, scheme == "https", req, &resp)) {
+    if (!DoHttpGet(vm, args[0].Bytes(), header, &resp)) {
         return Value();
     }
     return resp.ToValue();
 }
 
+//hands each decoded chunk of a body to a script function,returning false from the
+//function stops the download
+class FunctionSink : public BodySink {
+public:
+    FunctionSink(const Value& func, VMContext* ctx, Executor* vm)
+            : mFunction(func), mContext(ctx), mExecutor(vm) {}
+    bool Write(const char* data, size_t size) {
+        std::vector<Value> args;
+        args.push_back(Value::make_bytes(std::string(data, size)));
+        Value ret;
+        //a script error is raised again once the parser returned
+        try {
+            if (mFunction.Type == ValueType::kRuntimeFunction) {
+                ret = mFunction.RuntimeFunction(args, mContext, mExecutor);
+            } else {
+                ret = mExecutor->CallScriptFunction(mFunction.Function, args, mContext);
+            }
+        } catch (const RuntimeException& e) {
+            mError = e.what();
+            return false;
+        }
+        return !(ret.Type == ValueType::kInteger && ret.Integer == 0);
+    }
+    const std::string& Error() const { return mError; }
+
+private:
+    Value mFunction;
+    VMContext* mContext;
+    Executor* mExecutor;
+    std::string mError;
+};
+
+class FileSink : public BodySink {
+public:
+    explicit FileSink(FILE* file) : mFile(file) {}
+    bool Write(const char* data, size_t size) { return fwrite(data, 1, size, mFile) == size; }
+
+private:
+    FILE* mFile;
+};
+
+//HttpGetStream(url,sink[,header[,maxBodySize]]),the body is decoded while it's received and
+//handed to the sink instead of being kept:a function is called with each chunk (returning
+//false stops it),a string is the path of a file the body is written to.a body larger than
+//maxBodySize fails the request.returns the response without the body,its decoded size is
+//"body_size"
+Value HttpGetStream(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(2);
+    CHECK_PARAMETER_STRING(0);
+    Value header;
+    if (args.size() > 2 && args[2].Type == ValueType::kMap) {
+        header = args[2];
+    }
+    HTTPResponse resp;
+    if (args.size() > 3) {
+        CHECK_PARAMETER_INTEGER(3);
+        resp.MaxBodySize = args[3].Integer > 0 ? (size_t)args[3].Integer : 0;
+    }
+    FILE* file = NULL;
+    BodySink* sink = NULL;
+    FunctionSink* function = NULL;
+    if (args[1].Type == ValueType::kFunction || args[1].Type == ValueType::kRuntimeFunction) {
+        function = new FunctionSink(args[1], ctx, vm);
+        sink = function;
+    } else {
+        CHECK_PARAMETER_STRING(1);
+        file = fopen(args[1].Bytes().c_str(), "wb");
+        if (file == NULL) {
+            throw RuntimeException("HttpGetStream: can't open " + args[1].Bytes());
+        }
+        sink = new FileSink(file);
+    }
+    resp.Sink = sink;
+    bool ok = DoHttpGet(vm, args[0].Bytes(), header, &resp);
+    std::string error = function ? function->Error() : "";
+    size_t size = resp.Decoder ? resp.Decoder->DecodedSize() : 0;
+    delete sink;
+    if (file != NULL && fclose(file) != 0) {
+        ok = false;
+    }
+    if (!error.empty()) {
+        throw RuntimeException(error);
+    }
+    if (!ok) {
+        return Value();
+    }
+    Value ret = resp.ToValue();
+    //the body went to the sink
+    ret._map().erase("body");
+    ret._map()["body_size"] = Value(size);
+    return ret;
+}
+
 Value HttpPost(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(3);
     CHECK_PARAMETER_STRING(0); //URL
@@ -769,14 +1146,14 @@ Value HttpPost(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     std::map<std::string, std::string> headers;
     std::map<std::string, std::string> querys;
     std::string host, port, scheme, path;
-    parser_url(args[0].bytes, scheme, host, port, path, querys);
+    parser_url(args[0].Bytes(), scheme, host, port, path, querys);
     if (args.size() == 4 && args[3].Type == ValueType::kMap) {
         BuildRequestHeader(args[3], host, port, headers);
     } else {
         BuildRequestHeader(Value(), host, port, headers);
     }
-    headers["Content-Type"] = args[1].bytes;
-    headers["Content-Length"] = Value(args[2].bytes.size()).ToString();
+    headers["Content-Type"] = args[1].Bytes();
+    headers["Content-Length"] = Value(args[2].Bytes().size()).ToString();
     std::stringstream o;
     o << "POST " << escape(path, encodePath);
     if (querys.size()) {
@@ -789,11 +1166,11 @@ Value HttpPost(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
         iter++;
     }
     o << "\r\n";
-    o << args[2].bytes;
+    o << args[2].Bytes();
 
     std::string req = o.str();
     HTTPResponse resp;
-    if (!DoHttpRequest(host, port, scheme == "https", req, &resp)) {
+    if (!DoHttpRequest(vm, host, port, scheme == "https", req, &resp)) {
         return Value();
     }
     return resp.ToValue();
@@ -810,14 +1187,14 @@ Value HttpPostForm(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     Value query = URLQueryEncode(querys, ctx, vm);
     std::map<std::string, std::string> headers;
     std::string host, port, scheme, path;
-    parser_url(args[0].bytes, scheme, host, port, path, uq);
+    parser_url(args[0].Bytes(), scheme, host, port, path, uq);
     if (args.size() == 3 && args[2].Type == ValueType::kMap) {
         BuildRequestHeader(args[2], host, port, headers);
     } else {
         BuildRequestHeader(Value(), host, port, headers);
     }
     headers["Content-Type"] = "application/x-www-form-urlencoded";
-    headers["Content-Length"] = Value(query.bytes.size()).ToString();
+    headers["Content-Length"] = Value(query.Bytes().size()).ToString();
     std::stringstream o;
     o << "POST " << escape(path, encodePath);
     if (uq.size()) {
@@ -830,18 +1207,44 @@ Value HttpPostForm(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
         iter++;
     }
     o << "\r\n";
-    o << query.bytes;
+    o << query.Bytes();
 
     std::string req = o.str();
-    std::cout << req << std::endl;
+    fwrite(req.data(), 1, req.size(), vm->GetOutput());
+    fputc('\n', vm->GetOutput());
     HTTPResponse resp;
-    if (!DoHttpRequest(host, port, scheme == "https", req, &resp)) {
+    if (!DoHttpRequest(vm, host, port, scheme == "https", req, &resp)) {
         return Value();
     }
     return resp.ToValue();
 }
 
+//HttpSetPoolLimits(maxIdle,maxPerHost[,idleTimeout]),idle connections kept at most in all
+//and for one scheme://host:port,and the seconds one may be idle.0 disables the pool
+Value HttpSetPoolLimits(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(2);
+    CHECK_PARAMETER_INTEGER(0);
+    CHECK_PARAMETER_INTEGER(1);
+    int idleTimeout = 30;
+    if (args.size() > 2) {
+        CHECK_PARAMETER_INTEGER(2);
+        idleTimeout = (int)args[2].Integer;
+    }
+    if (args[0].Integer < 0 || args[1].Integer < 0) {
+        throw RuntimeException("HttpSetPoolLimits: the limits can't be negative");
+    }
+    HTTPConnectionPool::Of(vm)->SetLimits((size_t)args[0].Integer, (size_t)args[1].Integer,
+                                          idleTimeout);
+    return Value();
+}
+
+//{"opened":connections opened,"reused":requests sent on a pooled one,"idle":pooled now}
+Value HttpPoolStats(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    return HTTPConnectionPool::Of(vm)->Stats();
+}
+
 BuiltinMethod httpMethod[] = {{"HttpGet", HttpGet},
+                              {"HttpGetStream", HttpGetStream},
                               {"HttpPost", HttpPost},
                               {"HttpPostForm", HttpPostForm},
                               {"DeflateBytes", DeflateBytes},
@@ -855,7 +1258,9 @@ BuiltinMethod httpMethod[] = {{"HttpGet", HttpGet},
                               {"URLPathEscape", URLPathEscape},
                               {"URLQueryUnescape", URLQueryUnescape},
                               {"URLPathUnescape", URLPathUnescape},
-                              {"ReadHttpResponse", ReadHttpResponse}};
+                              {"ReadHttpResponse", ReadHttpResponse},
+                              {"HttpSetPoolLimits", HttpSetPoolLimits},
+                              {"HttpPoolStats", HttpPoolStats}};
 
 void RegisgerHttpBuiltinMethod(Executor* vm) {
     vm->RegisgerFunction(httpMethod, COUNT_OF(httpMethod));
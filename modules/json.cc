@@ -2,17 +2,20 @@
 #include "check.hpp"
 using namespace Interpreter;
 
-Value ParseJSON(std::string& str);
+Value ParseJSON(const std::string& str);
 
 Value JSONDecode(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
     CHECK_PARAMETER_STRING(0);
-    return ParseJSON(args[0].bytes);
+    return ParseJSON(args[0].Bytes());
 }
 
 Value JSONEncode(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(1);
-    return args[0].ToJSONString();
+    Value result("");
+    ValueWriter writer(result.MutableBytes());
+    writer.WriteJSON(args[0]);
+    return result;
 }
 
 BuiltinMethod jsonMethod[] = {{"JSONDecode", JSONDecode}, {"JSONEncode", JSONEncode}};
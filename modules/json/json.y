@@ -1,3 +1,4 @@
+%define api.pure full
 %parse-param {JSONParser * parser}
 %lex-param {JSONParser * parser}
 %{
@@ -7,7 +8,6 @@
 %{
 // https://stackoverflow.com/questions/23717039/generating-a-compiler-from-lex-and-yacc-grammar
 //int yylex(JSONParser * parser);
-int parser_json(JSONParser * parser);
 void parser_json_error(JSONParser * parser,const char *s);
 #define yylex   parser_json
 #define yyerror parser_json_error
@@ -18,6 +18,9 @@ void parser_json_error(JSONParser * parser,const char *s);
     JSONValue*       object;
     JSONMember*      member;
 };
+%{
+int parser_json(YYSTYPE* lval, JSONParser * parser);
+%}
 
 
 %token  <text> NUMBER STRING_LITERAL LC RC COMMA LB RB COLON TRUE FALSE NIL
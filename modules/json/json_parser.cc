@@ -1,11 +1,16 @@
 #include "json_parser.hpp"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
 #include "../../value.hpp"
 namespace json {
 #include "json.lex.cpp"
 #include "json.tab.cpp"
 void parser_json_error(json::JSONParser* parser, const char* s) {
-    printf("parser_json error : %s on line:%d\n", s, yylineno);
+    fprintf(ThreadLogOutput(), "parser_json error : %s on line:%d\n", s,
+            yyget_lineno(parser->GetScanner()));
 }
 } // namespace json
 
@@ -21,7 +26,7 @@ Value JSONValueToValue(json::JSONValue* val) {
         ret = Value::make_array();
         auto iter = val->Array.begin();
         while (iter != val->Array.end()) {
-            ret._array().push_back(JSONValueToValue(*iter));
+            ret.Array()->Push(JSONValueToValue(*iter));
             iter++;
         }
         return ret;
@@ -37,7 +42,7 @@ Value JSONValueToValue(json::JSONValue* val) {
         return ret;
     }
     case json::JSONValue::NUMBER:
-        if (val->Value.find(".") != std::string::npos) {
+        if (val->Value.find_first_of(".eE") != std::string::npos) {
             return Value(strtod(val->Value.c_str(), NULL));
         }
         return Value(strtoll(val->Value.c_str(), NULL, 0));
@@ -55,19 +60,19 @@ Value JSONValueToValue(json::JSONValue* val) {
     }
 }
 
-Value ParseJSON(std::string& str) {
-    json::YY_BUFFER_STATE bp;
-    json::JSONParser* parser = new json::JSONParser();
-    bp = json::yy_scan_bytes(str.c_str(), str.size());
-    yy_switch_to_buffer(bp);
-    int error = json::yyparse(parser);
-    json::yy_flush_buffer(bp);
-    json::yy_delete_buffer(bp);
-    json::yylex_destroy();
+Value ParseJSON(const std::string& str) {
+    json::yyscan_t scanner;
+    if (json::yylex_init(&scanner) != 0) {
+        return Value();
+    }
+    json::JSONParser parser;
+    json::YY_BUFFER_STATE bp = json::yy_scan_bytes(str.c_str(), str.size(), scanner);
+    parser.SetScanner(scanner);
+    int error = json::yyparse(&parser);
+    json::yy_delete_buffer(bp, scanner);
+    json::yylex_destroy(scanner);
     if (error) {
         return Value();
     }
-    Value ret = JSONValueToValue(parser->root);
-    delete parser;
-    return ret;
+    return JSONValueToValue(parser.root);
 }
@@ -37,9 +37,11 @@ private:
     std::string mScanningString;
     std::list<JSONValue*> mValueHolder;
     std::list<JSONMember*> mMemberHolder;
+    //yyscan_t of the lexer reading the text
+    void* mScanner;
 
 public:
-    JSONParser() : root(NULL) {}
+    JSONParser() : mScanner(NULL), root(NULL) {}
     ~JSONParser() {
         auto iter = mStringHolder.begin();
         while (iter != mStringHolder.end()) {
@@ -61,6 +63,8 @@ public:
     JSONValue* root;
 
 public:
+    void SetScanner(void* scanner) { mScanner = scanner; }
+    void* GetScanner() const { return mScanner; }
     void StartScanningString() { mScanningString.clear(); }
     void AppendToScanningString(char ch) { mScanningString += ch; }
     void AppendToScanningString(const char* text) { mScanningString += text; }
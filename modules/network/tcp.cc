@@ -1,103 +1,591 @@
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
 
 #define TCP_IMPL 1
 #include "../../value.hpp"
 
+//result of a connect,read or write which ran out of time,-1 is a failure
+#define TCP_TIMEOUT (-2)
+
 using namespace Interpreter;
+
+int64_t monotonic_milliseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+//deadline of an operation which may take timeout_sec,-1 (no deadline) when it's not positive
+int64_t deadline_after(int timeout_sec) {
+    if (timeout_sec <= 0) {
+        return -1;
+    }
+    return monotonic_milliseconds() + (int64_t)timeout_sec * 1000;
+}
+
+//wait until the socket is ready for the events,1 when it's ready (or has an error the
+//next call reports),0 when the deadline passed and -1 on failure
+int wait_socket(int fd, short events, int64_t deadline) {
+    while (true) {
+        int wait = -1;
+        if (deadline >= 0) {
+            int64_t left = deadline - monotonic_milliseconds();
+            if (left <= 0) {
+                return 0;
+            }
+            wait = (int)left;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        int rv = poll(&pfd, 1, wait);
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rv == 0) {
+            //poll may return a bit early,the deadline is checked again
+            continue;
+        }
+        return rv < 0 ? -1 : 1;
+    }
+}
+
+//a send to a peer which closed fails with EPIPE instead of raising SIGPIPE.MSG_NOSIGNAL
+//covers send(),SO_NOSIGPIPE covers every write of the socket (TLS ones too) where it
+//exists.elsewhere TLS writes rely on main ignoring SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define TCP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define TCP_SEND_FLAGS 0
+#endif
+
+void set_nosigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+//the SSL_CTX of all TLS streams of the process.the last session a server gave is kept
+//by host:port,and the next connection to it offers the session to skip the full handshake
+class TLSClient {
+public:
+    static TLSClient& Instance() {
+        //never freed,streams may be closed while other globals are destroyed
+        static TLSClient* client = new TLSClient();
+        return *client;
+    }
+
+    //a SSL for the target,with its cached session set when there is one
+    SSL* NewSSL(const std::string* target) {
+        SSL* ssl = SSL_new(mContext);
+        //read back by OnNewSession,the target lives as long as the stream
+        SSL_set_app_data(ssl, target);
+        std::lock_guard<std::mutex> guard(mLock);
+        std::map<std::string, SSL_SESSION*>::iterator iter = mSessions.find(*target);
+        if (iter != mSessions.end()) {
+            SSL_set_session(ssl, iter->second);
+        }
+        return ssl;
+    }
+    void HandshakeFinished(SSL* ssl) {
+        std::lock_guard<std::mutex> guard(mLock);
+        mHandshakes++;
+        if (SSL_session_reused(ssl)) {
+            mResumed++;
+        }
+    }
+    void GetStats(int64_t& handshakes, int64_t& resumed) {
+        std::lock_guard<std::mutex> guard(mLock);
+        handshakes = mHandshakes;
+        resumed = mResumed;
+    }
+
+private:
+    //sessions kept at most,a sweep over more hosts drops an entry for each new one
+    static const size_t kMaxSessions = 4096;
+
+    TLSClient() : mHandshakes(0), mResumed(0) {
+        mContext = SSL_CTX_new(SSLv23_method());
+        //OpenSSL hands new sessions to OnNewSession (for TLS 1.3 they come after the
+        //handshake),the internal store is only used by servers
+        SSL_CTX_set_session_cache_mode(mContext,
+                                       SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(mContext, OnNewSession);
+    }
+    static int OnNewSession(SSL* ssl, SSL_SESSION* session) {
+        const std::string* target = (const std::string*)SSL_get_app_data(ssl);
+        if (target == NULL) {
+            return 0;
+        }
+        Instance().Save(*target, session);
+        //the reference of the session is taken
+        return 1;
+    }
+    void Save(const std::string& target, SSL_SESSION* session) {
+        std::lock_guard<std::mutex> guard(mLock);
+        std::map<std::string, SSL_SESSION*>::iterator iter = mSessions.find(target);
+        if (iter != mSessions.end()) {
+            SSL_SESSION_free(iter->second);
+            iter->second = session;
+            return;
+        }
+        if (mSessions.size() >= kMaxSessions) {
+            SSL_SESSION_free(mSessions.begin()->second);
+            mSessions.erase(mSessions.begin());
+        }
+        mSessions[target] = session;
+    }
+
+private:
+    SSL_CTX* mContext;
+    std::mutex mLock;
+    std::map<std::string, SSL_SESSION*> mSessions;
+    int64_t mHandshakes;
+    int64_t mResumed;
+};
+
+//the socket of a stream is non-blocking,every read and write waits for it with
+//poll until the deadline of the operation
 class TCPStream : public Interpreter::Resource {
 public:
     int mSocket;
-    SSL_CTX* mSSLContext;
     SSL* mSSL;
+    //seconds a read or write may take,0 waits forever
+    int mTimeout;
+    //host:port,the key of the TLS session
+    std::string mTarget;
 
 public:
-    explicit TCPStream(int fd, bool bSSL) {
+    explicit TCPStream(int fd, bool bSSL, int timeout_sec, const std::string& host,
+                       const std::string& port) {
         mSocket = fd;
-        mSSLContext = NULL;
         mSSL = NULL;
+        mTimeout = timeout_sec;
+        mTarget = host + ":" + port;
         if (bSSL) {
-            mSSLContext = SSL_CTX_new(SSLv23_method());
-            mSSL = SSL_new(mSSLContext);
+            mSSL = TLSClient::Instance().NewSSL(&mTarget);
             SSL_set_fd(mSSL, mSocket);
+            //server name indication,an address is not sent as a name
+            struct in6_addr addr;
+            if (inet_pton(AF_INET, host.c_str(), &addr) != 1 &&
+                inet_pton(AF_INET6, host.c_str(), &addr) != 1) {
+                SSL_set_tlsext_host_name(mSSL, host.c_str());
+            }
         }
     }
+    //~Resource runs once this part is gone,its Close can't reach this one
+    ~TCPStream() { Close(); }
     void Close() {
         if (mSSL) {
+            //a session freed without close_notify is marked not resumable,the socket
+            //is non-blocking so this doesn't wait for the peer
+            if (SSL_is_init_finished(mSSL)) {
+                SSL_shutdown(mSSL);
+            }
             SSL_free(mSSL);
-            SSL_CTX_free(mSSLContext);
-            mSSLContext = NULL;
             mSSL = NULL;
         }
         if (mSocket != -1) {
             shutdown(mSocket, SHUT_RDWR);
+            close(mSocket);
             mSocket = -1;
         }
     }
     bool IsAvaliable() { return mSocket != -1; }
 
-    int Recv(void* buf, int size) {
-        if (mSSL) {
-            return SSL_read(mSSL, buf, size);
+    //1 when the handshake finished,TCP_TIMEOUT or -1 otherwise
+    int Handshake(int64_t deadline) {
+        while (true) {
+            int rv = SSL_connect(mSSL);
+            if (rv == 1) {
+                TLSClient::Instance().HandshakeFinished(mSSL);
+                return 1;
+            }
+            int ret = WaitToRetry(rv, POLLOUT, deadline);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+
+    //bytes read,0 when the peer closed the stream,TCP_TIMEOUT or -1
+    int Recv(void* buf, int size) { return Recv(buf, size, mTimeout); }
+    int Recv(void* buf, int size, int timeout_sec) {
+        int64_t deadline = deadline_after(timeout_sec);
+        while (true) {
+            int rv = mSSL ? SSL_read(mSSL, buf, size) : recv(mSocket, buf, size, 0);
+            if (rv > 0 || (rv == 0 && mSSL == NULL)) {
+                return rv;
+            }
+            if (mSSL && SSL_get_error(mSSL, rv) == SSL_ERROR_ZERO_RETURN) {
+                return 0;
+            }
+            int ret = WaitToRetry(rv, POLLIN, deadline);
+            if (ret != 0) {
+                return ret;
+            }
         }
-        return recv(mSocket, buf, size, 0);
     }
 
+    //all bytes are written before it returns size,TCP_TIMEOUT or -1 otherwise
     int Send(const void* buf, int size) {
-        if (mSSL) {
-            return SSL_write(mSSL, buf, size);
+        int64_t deadline = deadline_after(mTimeout);
+        int sent = 0;
+        while (sent < size) {
+            const char* data = (const char*)buf + sent;
+            int rv = mSSL ? SSL_write(mSSL, data, size - sent)
+                          : send(mSocket, data, size - sent, TCP_SEND_FLAGS);
+            if (rv > 0) {
+                sent += rv;
+                continue;
+            }
+            int ret = WaitToRetry(rv, POLLOUT, deadline);
+            if (ret != 0) {
+                return ret;
+            }
         }
-        return send(mSocket, buf, size, 0);
+        return sent;
     }
     std::string TypeName() { return "TCPStream"; }
+
+protected:
+    //a call returned rv without finishing,wait for the socket when the call would block.
+    //0 to retry the call,TCP_TIMEOUT or -1 to give up
+    int WaitToRetry(int rv, short events, int64_t deadline) {
+        if (mSSL) {
+            int err = SSL_get_error(mSSL, rv);
+            if (err == SSL_ERROR_WANT_READ) {
+                events = POLLIN;
+            } else if (err == SSL_ERROR_WANT_WRITE) {
+                events = POLLOUT;
+            } else {
+                return -1;
+            }
+        } else if (errno == EINTR) {
+            return 0;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        int ready = wait_socket(mSocket, events, deadline);
+        if (ready == 0) {
+            return TCP_TIMEOUT;
+        }
+        return ready < 0 ? -1 : 0;
+    }
 };
 
-int open_connection(const char* host, const char* port, int timeout_sec) {
+//connect to the first address of the host which accepts before the deadline,
+//the socket is left non-blocking.TCP_TIMEOUT when the time ran out,-1 on failure
+int open_connection(const char* host, const char* port, int64_t deadline) {
     struct addrinfo hints, *servinfo, *p;
-    int rv, sockfd;
+    int sockfd = -1;
+    bool timeout = false;
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
-    if ((rv = getaddrinfo(host, port, &hints, &servinfo)) != 0) {
-        return rv;
+    if (getaddrinfo(host, port, &hints, &servinfo) != 0) {
+        return -1;
     }
-
     for (p = servinfo; p != NULL; p = p->ai_next) {
         if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
             continue;
         }
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-            shutdown(sockfd, SHUT_RDWR);
+        if (!set_nonblocking(sockfd)) {
+            close(sockfd);
+            sockfd = -1;
             continue;
         }
-        break;
+        set_nosigpipe(sockfd);
+        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == 0) {
+            break;
+        }
+        if (errno == EINPROGRESS) {
+            int ready = wait_socket(sockfd, POLLOUT, deadline);
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (ready > 0 && getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 &&
+                error == 0) {
+                break;
+            }
+            //the deadline covers all addresses of the host
+            timeout = (ready == 0);
+        }
+        close(sockfd);
+        sockfd = -1;
+        if (timeout) {
+            break;
+        }
     }
     freeaddrinfo(servinfo);
-    if (p == NULL) {
-        return -1;
+    if (sockfd == -1) {
+        return timeout ? TCP_TIMEOUT : -1;
     }
     return sockfd;
 }
 
-TCPStream* NewTCPStream(std::string& host, std::string& port, int timeout_sec, bool isSSL) {
-    int sockfd = open_connection(host.c_str(), port.c_str(), timeout_sec);
+//connect,and shake hands when isSSL,within timeout_sec.reads and writes of the stream
+//take io_timeout_sec,the connect timeout when it's not given.
+//on failure error is set to TCP_TIMEOUT or -1
+TCPStream* NewTCPStream(std::string& host, std::string& port, int timeout_sec, bool isSSL,
+                        int io_timeout_sec = -1, int* error = NULL) {
+    if (io_timeout_sec < 0) {
+        io_timeout_sec = timeout_sec;
+    }
+    int64_t deadline = deadline_after(timeout_sec);
+    int sockfd = open_connection(host.c_str(), port.c_str(), deadline);
     if (sockfd < 0) {
+        if (error) {
+            *error = sockfd;
+        }
         return NULL;
     }
     if (!isSSL) {
-        return new TCPStream(sockfd, false);
+        return new TCPStream(sockfd, false, io_timeout_sec, host, port);
     }
-    TCPStream* stream = new TCPStream(sockfd, true);
-    if (SSL_connect(stream->mSSL) < 0) {
+    TCPStream* stream = new TCPStream(sockfd, true, io_timeout_sec, host, port);
+    int ret = stream->Handshake(deadline);
+    if (ret != 1) {
+        if (error) {
+            *error = ret;
+        }
         delete stream;
         return NULL;
     }
     //SSL_get_peer_certificate copy x509
     return stream;
-}
\ No newline at end of file
+}
+
+//a target of connect_many and what was found there
+struct TCPProbe {
+    enum Status { kOpen, kClosed, kTimeout, kError };
+    std::string Host;
+    std::string Port;
+    Status Result;
+    //milliseconds the connect took,-1 when it didn't connect
+    int64_t RTT;
+    std::string Banner;
+};
+
+//a probe which is in flight
+struct PendingProbe {
+    enum Phase { kConnecting, kSending, kReading, kDone };
+    size_t Index;
+    int Socket;
+    Phase Step;
+    size_t Sent;
+    int64_t Start;
+    int64_t Deadline;
+    //the addresses of the target,Next is the one tried when the current one fails
+    struct addrinfo* Addresses;
+    struct addrinfo* Next;
+};
+
+//connect to the next address of the probe which doesn't fail at once,kDone with the
+//result of the last failure when none is left.like open_connection every address of
+//the host is tried,within the one deadline of the probe
+void connect_next(TCPProbe& probe, PendingProbe& pending) {
+    while (pending.Next != NULL) {
+        struct addrinfo* p = pending.Next;
+        pending.Next = p->ai_next;
+        int fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd == -1 || !set_nonblocking(fd)) {
+            if (fd != -1) {
+                close(fd);
+            }
+            probe.Result = TCPProbe::kError;
+            continue;
+        }
+        set_nosigpipe(fd);
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == -1 && errno != EINPROGRESS) {
+            probe.Result = errno == ECONNREFUSED ? TCPProbe::kClosed : TCPProbe::kError;
+            close(fd);
+            continue;
+        }
+        pending.Socket = fd;
+        pending.Step = PendingProbe::kConnecting;
+        return;
+    }
+    pending.Step = PendingProbe::kDone;
+}
+
+//release what a probe holds once it's kDone
+void finish_probe(PendingProbe& pending) {
+    if (pending.Socket != -1) {
+        close(pending.Socket);
+        pending.Socket = -1;
+    }
+    if (pending.Addresses != NULL) {
+        freeaddrinfo(pending.Addresses);
+        pending.Addresses = pending.Next = NULL;
+    }
+}
+
+//start the connect of a probe,it's kDone at once when the connect failed already
+void start_probe(TCPProbe& probe, PendingProbe& pending, int timeout_sec) {
+    pending.Socket = -1;
+    pending.Step = PendingProbe::kDone;
+    pending.Sent = 0;
+    pending.Start = monotonic_milliseconds();
+    pending.Deadline = deadline_after(timeout_sec);
+    pending.Addresses = pending.Next = NULL;
+    probe.Result = TCPProbe::kError;
+    probe.RTT = -1;
+    struct addrinfo hints, *servinfo;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(probe.Host.c_str(), probe.Port.c_str(), &hints, &servinfo) != 0) {
+        return;
+    }
+    pending.Addresses = pending.Next = servinfo;
+    connect_next(probe, pending);
+}
+
+//go on with a probe whose socket is ready,payload is sent once it connected and
+//then up to bannerSize bytes are read
+void advance_probe(TCPProbe& probe, PendingProbe& pending, const std::string& payload,
+                   int bannerSize) {
+    if (pending.Step == PendingProbe::kConnecting) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(pending.Socket, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            probe.Result = error == ECONNREFUSED ? TCPProbe::kClosed : TCPProbe::kError;
+            close(pending.Socket);
+            pending.Socket = -1;
+            connect_next(probe, pending);
+            return;
+        }
+        probe.Result = TCPProbe::kOpen;
+        probe.RTT = monotonic_milliseconds() - pending.Start;
+        pending.Step = PendingProbe::kSending;
+    }
+    if (pending.Step == PendingProbe::kSending) {
+        while (pending.Sent < payload.size()) {
+            ssize_t rv = send(pending.Socket, payload.data() + pending.Sent,
+                              payload.size() - pending.Sent, TCP_SEND_FLAGS);
+            if (rv > 0) {
+                pending.Sent += rv;
+                continue;
+            }
+            if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                return;
+            }
+            pending.Step = PendingProbe::kDone;
+            return;
+        }
+        pending.Step = bannerSize > 0 ? PendingProbe::kReading : PendingProbe::kDone;
+        return;
+    }
+    if (pending.Step == PendingProbe::kReading) {
+        std::string buffer(bannerSize, '\0');
+        ssize_t rv = recv(pending.Socket, &buffer[0], buffer.size(), 0);
+        if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (rv > 0) {
+            probe.Banner.assign(buffer.data(), rv);
+        }
+        pending.Step = PendingProbe::kDone;
+    }
+}
+
+//connect to all targets with up to concurrency connects in flight,every probe is
+//given timeout_sec (which must be positive) from its connect to its banner.one poll()
+//waits for all sockets.
+//a probe which connected but got no banner in time is still kOpen
+void connect_many(std::vector<TCPProbe>& probes, int concurrency, int timeout_sec,
+                  const std::string& payload, int bannerSize) {
+    if (concurrency < 1) {
+        concurrency = 1;
+    }
+    std::vector<PendingProbe> active;
+    std::vector<struct pollfd> fds;
+    size_t next = 0;
+    while (next < probes.size() || !active.empty()) {
+        while (active.size() < (size_t)concurrency && next < probes.size()) {
+            PendingProbe pending;
+            pending.Index = next++;
+            start_probe(probes[pending.Index], pending, timeout_sec);
+            if (pending.Step != PendingProbe::kDone) {
+                active.push_back(pending);
+            } else {
+                finish_probe(pending);
+            }
+        }
+        if (active.empty()) {
+            continue;
+        }
+        int64_t now = monotonic_milliseconds();
+        int wait = -1;
+        fds.resize(active.size());
+        for (size_t i = 0; i < active.size(); i++) {
+            fds[i].fd = active[i].Socket;
+            fds[i].events = active[i].Step == PendingProbe::kReading ? POLLIN : POLLOUT;
+            fds[i].revents = 0;
+            if (active[i].Deadline >= 0) {
+                int64_t left = active[i].Deadline - now;
+                left = left < 0 ? 0 : left;
+                if (wait < 0 || left < wait) {
+                    wait = (int)left;
+                }
+            }
+        }
+        if (poll(fds.data(), fds.size(), wait) < 0 && errno != EINTR) {
+            break;
+        }
+        now = monotonic_milliseconds();
+        size_t kept = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            PendingProbe& pending = active[i];
+            TCPProbe& probe = probes[pending.Index];
+            if (fds[i].revents != 0) {
+                advance_probe(probe, pending, payload, bannerSize);
+            }
+            if (pending.Step != PendingProbe::kDone && pending.Deadline >= 0 &&
+                now >= pending.Deadline) {
+                if (pending.Step == PendingProbe::kConnecting) {
+                    probe.Result = TCPProbe::kTimeout;
+                }
+                pending.Step = PendingProbe::kDone;
+            }
+            if (pending.Step == PendingProbe::kDone) {
+                finish_probe(pending);
+                continue;
+            }
+            active[kept++] = pending;
+        }
+        active.resize(kept);
+    }
+    //poll failed,the probes left are errors
+    for (size_t i = 0; i < active.size(); i++) {
+        probes[active[i].Index].Result = TCPProbe::kError;
+        finish_probe(active[i]);
+    }
+}
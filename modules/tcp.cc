@@ -6,25 +6,40 @@
 #include "../vm.hpp"
 #include "check.hpp"
 using namespace Interpreter;
+
+//result of the last TCPConnect,TCPRead or TCPWrite of the thread,0 or the failure of
+//the call.a failed call returns nil and TCPIsTimeout tells a timeout from an error
+static thread_local int tcp_last_error = 0;
+
+//TCPConnect(host,port,timeout,isSSL[,ioTimeout]),reads and writes of the stream take
+//ioTimeout seconds,timeout when it's not given
 Value TCPConnect(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(4);
     CHECK_PARAMETER_STRING(0);
-    std::string host = args[0].bytes, port;
+    std::string host = args[0].Bytes(), port;
     if (args[1].Type == ValueType::kInteger) {
         port = args[1].ToString();
     } else {
         CHECK_PARAMETER_STRING(1);
-        port = args[1].bytes;
+        port = args[1].Bytes();
     }
     CHECK_PARAMETER_INTEGER(2);
     CHECK_PARAMETER_INTEGER(3);
-    Resource* res = NewTCPStream(host, port, (int)args[2].Integer, args[3].ToBoolean());
+    int ioTimeout = -1;
+    if (args.size() > 4) {
+        CHECK_PARAMETER_INTEGER(4);
+        ioTimeout = (int)args[4].Integer;
+    }
+    tcp_last_error = 0;
+    Resource* res = NewTCPStream(host, port, (int)args[2].Integer, args[3].ToBoolean(),
+                                 ioTimeout, &tcp_last_error);
     if (res == NULL) {
         return Value();
     }
     return Value(res);
 }
 
+//TCPRead(stream,length[,timeout]),timeout overrides the one of the stream for this read
 Value TCPRead(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_RESOURCE(0);
@@ -37,14 +52,20 @@ Value TCPRead(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     if (buffer == NULL) {
         return Value();
     }
-    TCPStream* stream = (TCPStream*)(args[0].resource.get());
-    int size = stream->Recv(buffer, (int)args[1].Integer);
+    TCPStream* stream = (TCPStream*)(args[0].GetResource());
+    int timeout = stream->mTimeout;
+    if (args.size() > 2) {
+        CHECK_PARAMETER_INTEGER(2);
+        timeout = (int)args[2].Integer;
+    }
+    int size = stream->Recv(buffer, (int)args[1].Integer, timeout);
+    tcp_last_error = size < 0 ? size : 0;
     if (size < 0) {
         free(buffer);
         return Value();
     }
     Value ret = Value::make_bytes("");
-    ret.bytes.assign((char*)buffer, size);
+    ret.MutableBytes().assign((char*)buffer, size);
     free(buffer);
     return ret;
 }
@@ -53,15 +74,87 @@ Value TCPWrite(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
     CHECK_PARAMETER_COUNT(2);
     CHECK_PARAMETER_RESOURCE(0);
     CHECK_PARAMETER_STRING(1);
-    TCPStream* stream = (TCPStream*)(args[0].resource.get());
-    int size = stream->Send(args[1].bytes.c_str(), args[1].bytes.size());
+    TCPStream* stream = (TCPStream*)(args[0].GetResource());
+    int size = stream->Send(args[1].Bytes().c_str(), args[1].Bytes().size());
+    tcp_last_error = size < 0 ? size : 0;
     return Value(size);
 }
 
+Value TCPIsTimeout(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    return Value(tcp_last_error == TCP_TIMEOUT);
+}
+
+//TCPConnectMany(targets,concurrency,timeout[,probe[,bannerSize]]),targets is an array of
+//"host:port" ("[::1]:port" for ipv6),every address of the host is tried in turn until
+//one connects.the probe is sent to every open target and up to bannerSize (default 1024)
+//bytes of its answer are read.returns a map from the target to
+//{"status":"open|closed|timeout|error","rtt":connect milliseconds,"banner":bytes}
+Value TCPConnectMany(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    CHECK_PARAMETER_COUNT(3);
+    CHECK_PARAMETER_ARRAY(0);
+    CHECK_PARAMETER_INTEGER(1);
+    CHECK_PARAMETER_INTEGER(2);
+    std::string payload;
+    int bannerSize = 1024;
+    if (args.size() > 3 && args[3].Type != ValueType::kNULL) {
+        CHECK_PARAMETER_STRING(3);
+        payload = args[3].Bytes();
+    }
+    if (args.size() > 4) {
+        CHECK_PARAMETER_INTEGER(4);
+        bannerSize = (int)args[4].Integer;
+    }
+    if (bannerSize > 1 * 1024 * 1024) {
+        throw RuntimeException("TCPConnectMany bannerSize must less 1M");
+    }
+    //without a deadline one silent target would hold the whole sweep
+    if (args[2].Integer <= 0) {
+        throw RuntimeException("TCPConnectMany timeout must be positive");
+    }
+    ArrayObject* targets = args[0].Array();
+    std::vector<TCPProbe> probes(targets->size());
+    for (size_t i = 0; i < targets->size(); i++) {
+        std::string target = targets->Get(i).ToString();
+        size_t pos = target.rfind(':');
+        if (pos != std::string::npos) {
+            probes[i].Host = target.substr(0, pos);
+            probes[i].Port = target.substr(pos + 1);
+        }
+        if (probes[i].Host.size() > 2 && probes[i].Host[0] == '[' &&
+            probes[i].Host[probes[i].Host.size() - 1] == ']') {
+            probes[i].Host = probes[i].Host.substr(1, probes[i].Host.size() - 2);
+        }
+    }
+    connect_many(probes, (int)args[1].Integer, (int)args[2].Integer, payload, bannerSize);
+    static const char* status[] = {"open", "closed", "timeout", "error"};
+    Value ret = Value::make_map();
+    for (size_t i = 0; i < probes.size(); i++) {
+        Value result = Value::make_map();
+        result._map()["status"] = status[probes[i].Result];
+        result._map()["rtt"] = Value(probes[i].RTT);
+        result._map()["banner"] = Value::make_bytes(probes[i].Banner);
+        ret._map()[targets->Get(i)] = result;
+    }
+    return ret;
+}
+
+//{"handshakes":TLS handshakes finished,"resumed":the ones which resumed a cached session}
+Value TLSSessionStats(std::vector<Value>& args, VMContext* ctx, Executor* vm) {
+    int64_t handshakes = 0, resumed = 0;
+    TLSClient::Instance().GetStats(handshakes, resumed);
+    Value ret = Value::make_map();
+    ret._map()["handshakes"] = Value(handshakes);
+    ret._map()["resumed"] = Value(resumed);
+    return ret;
+}
+
 BuiltinMethod tcpMethod[] = {
         {"TCPConnect", TCPConnect},
         {"TCPWrite", TCPWrite},
         {"TCPRead", TCPRead},
+        {"TCPIsTimeout", TCPIsTimeout},
+        {"TCPConnectMany", TCPConnectMany},
+        {"TLSSessionStats", TLSSessionStats},
 };
 
 void RegisgerTcpBuiltinMethod(Executor* vm) {
@@ -0,0 +1,380 @@
+#include "optimizer.hpp"
+
+#include "vmcontext.hpp"
+
+namespace Interpreter {
+
+Optimizer::Optimizer(Script* script) : mScript(script) {}
+
+void Optimizer::Optimize() {
+    if (mScript->EntryPoint == NULL) {
+        return;
+    }
+    mScript->EntryPoint = GetInstruction(OptimizeStatement(mScript->EntryPoint->key));
+}
+
+int Optimizer::CountInstructions() {
+    if (mScript->EntryPoint == NULL) {
+        return 0;
+    }
+    return CountInstructions(mScript->EntryPoint);
+}
+
+int Optimizer::CountInstructions(const Instruction* ins) {
+    int count = 1;
+    if (ins->IsConst()) {
+        return count;
+    }
+    InstructionList list = mScript->GetInstructions(ins->Refs);
+    for (size_t i = 0; i < list.size(); i++) {
+        count += CountInstructions(list[i]);
+    }
+    return count;
+}
+
+Optimizer::keyType Optimizer::NewConst(const Value& val) {
+    return mScript->NewConst(val)->key;
+}
+
+bool Optimizer::IsConstValue(keyType key, Value& val) {
+    const Instruction* ins = mScript->GetInstruction(key);
+    if (ins->OpCode != Instructions::kConst) {
+        return false;
+    }
+    val = mScript->GetConstValue(ins->Refs[0]);
+    return true;
+}
+
+//returns the key of the instruction which replaces the statement,the null
+//instruction when nothing left to run
+Optimizer::keyType Optimizer::OptimizeStatement(keyType key) {
+    Instruction* ins = GetInstruction(key);
+    switch (ins->OpCode) {
+    case Instructions::kNop:
+    case Instructions::kBREAKStatement:
+    case Instructions::kCONTINUEStatement:
+        return key;
+    case Instructions::kGroup:
+        return OptimizeStatementList(ins);
+    case Instructions::kIFStatement:
+        return OptimizeIFStatement(ins);
+    case Instructions::kContitionExpression:
+        return OptimizeConditionExpression(ins);
+    case Instructions::kFORStatement:
+        return OptimizeForStatement(ins);
+    case Instructions::kForInStatement:
+        ins->Refs[0] = OptimizeExpression(ins->Refs[0]);
+        ins->Refs[1] = OptimizeStatement(ins->Refs[1]);
+        return key;
+    case Instructions::kSwitchCaseStatement:
+        return OptimizeSwitchStatement(ins);
+    case Instructions::kNewFunction:
+        return OptimizeFunction(ins);
+    default:
+        break;
+    }
+    key = OptimizeExpression(key);
+    //a constant statement has no effect
+    if (mScript->GetInstruction(key)->IsConst()) {
+        return NULLKey();
+    }
+    return key;
+}
+
+//statements run in sequence without a scope of their own,so nested lists are
+//spliced into their parent
+Optimizer::keyType Optimizer::OptimizeStatementList(Instruction* ins) {
+    std::vector<keyType> refs;
+    for (size_t i = 0; i < ins->Refs.size(); i++) {
+        keyType key = OptimizeStatement(ins->Refs[i]);
+        const Instruction* item = mScript->GetInstruction(key);
+        if (item->OpCode == Instructions::kNop) {
+            continue;
+        }
+        if (item->OpCode == Instructions::kGroup) {
+            refs.insert(refs.end(), item->Refs.begin(), item->Refs.end());
+            continue;
+        }
+        refs.push_back(key);
+    }
+    if (refs.size() == 0) {
+        return NULLKey();
+    }
+    if (refs.size() == 1) {
+        return refs[0];
+    }
+    ins->Refs = refs;
+    return ins->key;
+}
+
+Optimizer::keyType Optimizer::OptimizeIFStatement(Instruction* ins) {
+    std::vector<Instruction*> branches;
+    branches.push_back(GetInstruction(ins->Refs[0]));
+    Instruction* elsif = GetInstruction(ins->Refs[1]);
+    for (size_t i = 0; i < elsif->Refs.size(); i++) {
+        branches.push_back(GetInstruction(elsif->Refs[i]));
+    }
+    keyType elseBranch = ins->Refs[2];
+    std::vector<keyType> alive;
+    for (size_t i = 0; i < branches.size(); i++) {
+        Instruction* branch = branches[i];
+        Value condition;
+        branch->Refs[0] = OptimizeExpression(branch->Refs[0]);
+        if (IsConstValue(branch->Refs[0], condition)) {
+            if (!condition.ToBoolean()) {
+                continue;
+            }
+            //the branches after an always taken one are unreachable
+            elseBranch = branch->Refs[1];
+            break;
+        }
+        branch->Refs[1] = OptimizeStatement(branch->Refs[1]);
+        alive.push_back(branch->key);
+    }
+    elseBranch = OptimizeStatement(elseBranch);
+    if (alive.size() == 0) {
+        return elseBranch;
+    }
+    ins->Refs[0] = alive[0];
+    ins->Refs[1] = NULLKey();
+    if (alive.size() > 1) {
+        elsif->Refs.assign(alive.begin() + 1, alive.end());
+        ins->Refs[1] = elsif->key;
+    }
+    ins->Refs[2] = elseBranch;
+    return ins->key;
+}
+
+Optimizer::keyType Optimizer::OptimizeConditionExpression(Instruction* ins) {
+    Value condition;
+    ins->Refs[0] = OptimizeExpression(ins->Refs[0]);
+    if (IsConstValue(ins->Refs[0], condition)) {
+        return condition.ToBoolean() ? OptimizeStatement(ins->Refs[1]) : NULLKey();
+    }
+    ins->Refs[1] = OptimizeStatement(ins->Refs[1]);
+    return ins->key;
+}
+
+//the loop keeps its scope,so the init part stays even if the body never runs
+Optimizer::keyType Optimizer::OptimizeForStatement(Instruction* ins) {
+    ins->Refs[0] = OptimizeStatement(ins->Refs[0]);
+    ins->Refs[1] = OptimizeExpression(ins->Refs[1]);
+    Value condition;
+    if (IsConstValue(ins->Refs[1], condition)) {
+        if (!condition.ToBoolean()) {
+            ins->Refs[2] = NULLKey();
+            ins->Refs[3] = NULLKey();
+            return ins->key;
+        }
+        ins->Refs[1] = NULLKey();
+    }
+    ins->Refs[2] = OptimizeStatement(ins->Refs[2]);
+    ins->Refs[3] = OptimizeStatement(ins->Refs[3]);
+    return ins->key;
+}
+
+Optimizer::keyType Optimizer::OptimizeSwitchStatement(Instruction* ins) {
+    ins->Refs[0] = OptimizeExpression(ins->Refs[0]);
+    Instruction* cases = GetInstruction(ins->Refs[1]);
+    for (size_t i = 0; i < cases->Refs.size(); i++) {
+        Instruction* item = GetInstruction(cases->Refs[i]);
+        item->Refs[0] = OptimizeExpression(item->Refs[0]);
+        item->Refs[1] = OptimizeStatement(item->Refs[1]);
+    }
+    ins->Refs[2] = OptimizeStatement(ins->Refs[2]);
+    return ins->key;
+}
+
+//only the body,the formal parameters are names
+Optimizer::keyType Optimizer::OptimizeFunction(Instruction* ins) {
+    ins->Refs[0] = OptimizeStatement(ins->Refs[0]);
+    return ins->key;
+}
+
+Optimizer::keyType Optimizer::OptimizeExpression(keyType key) {
+    Instruction* ins = GetInstruction(key);
+    if (ins->IsConst() || ins->IsNULL()) {
+        return key;
+    }
+    switch (ins->OpCode) {
+    case Instructions::kReadVar: {
+        Value val;
+        if (VMContext::GetBuiltinVar(ins->Name, val)) {
+            return NewConst(val);
+        }
+        return key;
+    }
+    case Instructions::kNewFunction:
+        return OptimizeFunction(ins);
+    case Instructions::kIFStatement:
+    case Instructions::kContitionExpression:
+    case Instructions::kFORStatement:
+    case Instructions::kForInStatement:
+    case Instructions::kSwitchCaseStatement:
+        return OptimizeStatement(key);
+    default:
+        break;
+    }
+    //lists in expressions (arguments,indexes,map items) keep their shape
+    for (size_t i = 0; i < ins->Refs.size(); i++) {
+        ins->Refs[i] = OptimizeExpression(ins->Refs[i]);
+    }
+    if (ins->OpCode >= Instructions::kADD && ins->OpCode <= Instructions::kMAXArithmeticOP) {
+        return FoldArithmetic(ins);
+    }
+    switch (ins->OpCode) {
+    case Instructions::kMinus:
+        return FoldMinus(ins);
+    case Instructions::kCreateMap:
+    case Instructions::kCreateArray:
+        return HoistLiteral(ins);
+    default:
+        return key;
+    }
+}
+
+Optimizer::keyType Optimizer::FoldArithmetic(Instruction* ins) {
+    Value left, right, result;
+    if (!IsConstValue(ins->Refs[0], left)) {
+        return ins->key;
+    }
+    if (ins->OpCode != Instructions::kNOT && ins->OpCode != Instructions::kBNG &&
+        !IsConstValue(ins->Refs[1], right)) {
+        return ins->key;
+    }
+    if (!Evaluate(ins->OpCode, left, right, result)) {
+        return ins->key;
+    }
+    return NewConst(result);
+}
+
+Optimizer::keyType Optimizer::FoldMinus(Instruction* ins) {
+    Value val;
+    if (!IsConstValue(ins->Refs[0], val)) {
+        return ins->key;
+    }
+    switch (val.Type) {
+    case ValueType::kInteger:
+        val.Integer = (-val.Integer);
+        return NewConst(val);
+    case ValueType::kFloat:
+        val.Float = (-val.Float);
+        return NewConst(val);
+    default:
+        return ins->key;
+    }
+}
+
+//a literal made only of constants is built once,the VM copies it on every evaluation
+Optimizer::keyType Optimizer::HoistLiteral(Instruction* ins) {
+    const Instruction* list = mScript->GetInstruction(ins->Refs[0]);
+    if (list->IsNULL()) {
+        return ins->key;
+    }
+    Value literal;
+    if (ins->OpCode == Instructions::kCreateArray) {
+        literal = Value::make_array();
+        for (size_t i = 0; i < list->Refs.size(); i++) {
+            Value item;
+            if (!IsConstValue(list->Refs[i], item)) {
+                return ins->key;
+            }
+            literal.Array()->Push(item);
+        }
+    } else {
+        literal = Value::make_map();
+        InstructionList items = mScript->GetInstructions(list->Refs);
+        for (size_t i = 0; i < items.size(); i++) {
+            Value itemKey, itemValue;
+            if (!IsConstValue(items[i]->Refs[0], itemKey) ||
+                !IsConstValue(items[i]->Refs[1], itemValue)) {
+                return ins->key;
+            }
+            literal._map()[itemKey] = itemValue;
+        }
+    }
+    Instruction* obj = mScript->NewConst(literal);
+    obj->OpCode = Instructions::kConstObject;
+    return obj->key;
+}
+
+bool Optimizer::Evaluate(Instructions::Type op, Value left, Value right, Value& result) {
+    try {
+        switch (op) {
+        case Instructions::kADD:
+            result = left + right;
+            return true;
+        case Instructions::kSUB:
+            result = left - right;
+            return true;
+        case Instructions::kMUL:
+            result = left * right;
+            return true;
+        case Instructions::kDIV:
+            //integer division by zero traps,leave it to the runtime
+            if (left.Type == ValueType::kInteger && right.Type == ValueType::kInteger &&
+                right.Integer == 0) {
+                return false;
+            }
+            result = left / right;
+            return true;
+        case Instructions::kMOD:
+            result = left % right;
+            return true;
+        case Instructions::kGT:
+            result = Value(left > right);
+            return true;
+        case Instructions::kGE:
+            result = Value(left >= right);
+            return true;
+        case Instructions::kLT:
+            result = Value(left < right);
+            return true;
+        case Instructions::kLE:
+            result = Value(left <= right);
+            return true;
+        case Instructions::kEQ:
+            result = Value(left == right);
+            return true;
+        case Instructions::kNE:
+            result = Value(left != right);
+            return true;
+        case Instructions::kNOT:
+            result = Value(!left.ToBoolean());
+            return true;
+        case Instructions::kBOR:
+            result = left | right;
+            return true;
+        case Instructions::kBAND:
+            result = left & right;
+            return true;
+        case Instructions::kBXOR:
+            result = left ^ right;
+            return true;
+        case Instructions::kBNG:
+            result = ~left;
+            return true;
+        case Instructions::kLSHIFT:
+        case Instructions::kRSHIFT:
+            //shifts out of the width are undefined,keep them as they are
+            if (right.Type == ValueType::kInteger && (right.Integer < 0 || right.Integer >= 64)) {
+                return false;
+            }
+            result = op == Instructions::kLSHIFT ? left << right : left >> right;
+            return true;
+        case Instructions::kOR:
+            result = Value(left.ToBoolean() || right.ToBoolean());
+            return true;
+        case Instructions::kAND:
+            result = Value(left.ToBoolean() && right.ToBoolean());
+            return true;
+        default:
+            return false;
+        }
+    } catch (const RuntimeException& e) {
+        //the error is raised when the expression runs
+        return false;
+    }
+}
+
+} // namespace Interpreter
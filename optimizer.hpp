@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "script.hpp"
+#include "value.hpp"
+
+namespace Interpreter {
+
+//Optimizer rewrites the instruction tree of a parsed script before it is compiled:
+//constant expressions are folded,unreachable branches and no-op statements are dropped,
+//nested statement lists are flattened and literals of constants are built only once
+class Optimizer {
+public:
+    explicit Optimizer(Script* script);
+
+    void Optimize();
+    //count of instructions reachable from the entry point
+    int CountInstructions();
+
+protected:
+    typedef Instruction::keyType keyType;
+
+    keyType OptimizeStatement(keyType key);
+    keyType OptimizeExpression(keyType key);
+    keyType OptimizeStatementList(Instruction* ins);
+    keyType OptimizeIFStatement(Instruction* ins);
+    keyType OptimizeConditionExpression(Instruction* ins);
+    keyType OptimizeForStatement(Instruction* ins);
+    keyType OptimizeSwitchStatement(Instruction* ins);
+    keyType OptimizeFunction(Instruction* ins);
+    keyType FoldArithmetic(Instruction* ins);
+    keyType FoldMinus(Instruction* ins);
+    keyType HoistLiteral(Instruction* ins);
+
+    //evaluate like the VM does,false when the operation must be left to the runtime
+    bool Evaluate(Instructions::Type op, Value left, Value right, Value& result);
+    bool IsConstValue(keyType key, Value& val);
+    keyType NewConst(const Value& val);
+    keyType NULLKey() { return mScript->NULLInstruction()->key; }
+    Instruction* GetInstruction(keyType key) { return (Instruction*)mScript->GetInstruction(key); }
+    int CountInstructions(const Instruction* ins);
+
+protected:
+    Script* mScript;
+};
+
+} // namespace Interpreter
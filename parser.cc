@@ -15,7 +15,7 @@ Instruction* Parser::CreateList(const std::string& typeName, Instruction* elemen
         LOG(mScript->DumpInstruction(element, ""));
     }
     Instruction* obj = mScript->NewGroup(element);
-    obj->Name = typeName;
+    obj->Name = SymbolTable::Intern(typeName);
     return obj;
 }
 
@@ -26,7 +26,7 @@ Instruction* Parser::AddToList(Instruction* list, Instruction* element) {
 Instruction* Parser::VarDeclarationExpresion(const std::string& name, Instruction* value) {
     Instruction* obj = mScript->NewInstruction();
     obj->OpCode = Instructions::kNewVar;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (value != NULL) {
         obj->Refs.push_back(value->key);
     }
@@ -41,7 +41,7 @@ Instruction* Parser::VarUpdateExpression(const std::string& name, Instruction* v
     if (value != NULL) {
         obj->Refs.push_back(value->key);
     }
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     obj->OpCode = opcode;
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
@@ -51,7 +51,7 @@ Instruction* Parser::VarUpdateExpression(const std::string& name, Instruction* v
 Instruction* Parser::VarReadExpresion(const std::string& name) {
     Instruction* obj = mScript->NewInstruction();
     obj->OpCode = Instructions::kReadVar;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -75,7 +75,7 @@ Instruction* Parser::CreateFunction(const std::string& name, Instruction* formal
         obj->Refs.push_back(formalParameters->key);
     }
     obj->OpCode = Instructions::kNewFunction;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -88,7 +88,7 @@ Instruction* Parser::CreateFunctionCall(const std::string& name, Instruction* ac
         obj->Refs.push_back(actualParameters->key);
     }
     obj->OpCode = Instructions::kCallFunction;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -187,7 +187,7 @@ Instruction* Parser::CreateContinueStatement() {
 Instruction* Parser::CreateMapItem(Instruction* key, Instruction* value) {
     Instruction* obj = mScript->NewInstruction(key, value);
     obj->OpCode = Instructions::kGroup;
-    obj->Name = "map-item";
+    obj->Name = SymbolTable::Intern("map-item");
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -218,7 +218,7 @@ Instruction* Parser::CreateArray(Instruction* list) {
 Instruction* Parser::VarReadAtExpression(const std::string& name, Instruction* where) {
     Instruction* obj = mScript->NewInstruction(where);
     obj->OpCode = Instructions::kReadAt;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -248,7 +248,7 @@ Instruction* Parser::VarUpdateAtExression(const std::string& name, Instruction*
     }
     Instruction* obj = mScript->NewInstruction(where, value);
     obj->OpCode = Instructions::kWriteAt;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -263,7 +263,7 @@ Instruction* Parser::VarSlice(const std::string& name, Instruction* from, Instru
     }
     Instruction* obj = mScript->NewInstruction(from, to);
     obj->OpCode = Instructions::kSlice;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -277,7 +277,7 @@ Instruction* Parser::CreateForInStatement(const std::string& key, const std::str
     name += val;
     Instruction* obj = mScript->NewInstruction(iterobj, body);
     obj->OpCode = Instructions::kForInStatement;
-    obj->Name = name;
+    obj->Name = SymbolTable::Intern(name);
     if (mLogInstruction) {
         LOG(mScript->DumpInstruction(obj, ""));
     }
@@ -15,9 +15,12 @@ protected:
     std::string mScanningString;
 
     bool mLogInstruction;
+    //yyscan_t of the lexer reading the file,every parser has its own
+    void* mScanner;
 
 public:
-    Parser() : mScript(NULL), mLogInstruction(0), mStringHolder(), mScanningString() {}
+    Parser()
+        : mScript(NULL), mLogInstruction(0), mStringHolder(), mScanningString(), mScanner(NULL) {}
     ~Parser() { Finish(); }
 
     void Start(std::string name) { mScript = new Script(name); }
@@ -34,17 +37,21 @@ public:
         return ret;
     }
     void SetLogInstruction(bool log) { mLogInstruction = log; }
+    void SetScanner(void* scanner) { mScanner = scanner; }
+    void* GetScanner() const { return mScanner; }
     //string parser helper function
     void StartScanningString() { mScanningString.clear(); }
     void AppendToScanningString(char ch) { mScanningString += ch; }
     void AppendToScanningString(const char* text) { mScanningString += text; }
-    const char* FinishScanningString() { return CreateString(mScanningString.c_str()); }
-    const char* CreateString(const char* text) {
-        //TODO: use string pools
-        std::string* obj = new std::string(text);
+    const char* FinishScanningString() {
+        std::string* obj = new std::string(mScanningString);
         mStringHolder.push_back(obj);
         return obj->c_str();
     }
+    //identifiers are interned,the text stays valid after the parser finished
+    const char* CreateString(const char* text) {
+        return SymbolTable::Name(SymbolTable::Intern(text)).c_str();
+    }
 
     //null instruction do nothing
     Instruction* NULLObject();
@@ -0,0 +1,421 @@
+#include "script.hpp"
+
+#include <string.h>
+
+namespace Interpreter {
+
+static const char kScriptMagic[4] = {'O', 'S', 'C', 'B'};
+static const int32_t kByteOrderMark = 0x01020304;
+
+static void WriteInt(std::ostream& o, int32_t val) {
+    o.write((const char*)&val, sizeof(val));
+}
+static void WriteVarint(std::ostream& o, uint64_t val) {
+    while (val >= 0x80) {
+        o.put((char)(val | 0x80));
+        val >>= 7;
+    }
+    o.put((char)val);
+}
+//zigzag keeps small negative numbers short
+static void WriteSignedVarint(std::ostream& o, int64_t val) {
+    WriteVarint(o, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+static void WriteDouble(std::ostream& o, double val) {
+    o.write((const char*)&val, sizeof(val));
+}
+static void WriteString(std::ostream& o, const std::string& val) {
+    WriteVarint(o, val.size());
+    o.write(val.c_str(), val.size());
+}
+
+void ScriptReader::Read(void* out, size_t size) {
+    if ((size_t)(mEnd - mPos) < size) {
+        throw RuntimeException("compiled script is truncated");
+    }
+    memcpy(out, mPos, size);
+    mPos += size;
+}
+unsigned char ScriptReader::ReadByte() {
+    unsigned char val = 0;
+    Read(&val, sizeof(val));
+    return val;
+}
+int32_t ScriptReader::ReadInt() {
+    int32_t val = 0;
+    Read(&val, sizeof(val));
+    return val;
+}
+uint64_t ScriptReader::ReadVarint() {
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = ReadByte();
+        val |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return val;
+        }
+    }
+    throw RuntimeException("compiled script is corrupted");
+}
+int64_t ScriptReader::ReadSignedVarint() {
+    uint64_t val = ReadVarint();
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+uint64_t ScriptReader::ReadCount() {
+    uint64_t count = ReadVarint();
+    if (count > (uint64_t)(mEnd - mPos)) {
+        throw RuntimeException("compiled script is truncated");
+    }
+    return count;
+}
+double ScriptReader::ReadDouble() {
+    double val = 0;
+    Read(&val, sizeof(val));
+    return val;
+}
+std::string ScriptReader::ReadString() {
+    uint64_t size = ReadVarint();
+    if ((uint64_t)(mEnd - mPos) < size) {
+        throw RuntimeException("compiled script is truncated");
+    }
+    std::string val(mPos, size);
+    mPos += size;
+    return val;
+}
+
+//consts are literals,so only data types can be met here
+static void WriteValue(std::ostream& o, const Value& val) {
+    o.put(val.Type);
+    switch (val.Type) {
+    case ValueType::kNULL:
+        return;
+    case ValueType::kInteger:
+        WriteSignedVarint(o, val.Integer);
+        return;
+    case ValueType::kFloat:
+        WriteDouble(o, val.Float);
+        return;
+    case ValueType::kString:
+    case ValueType::kBytes:
+        WriteString(o, val.Bytes());
+        return;
+    case ValueType::kArray: {
+        const ArrayObject* array = (const ArrayObject*)val.GetObject();
+        WriteVarint(o, array->size());
+        for (size_t i = 0; i < array->size(); i++) {
+            WriteValue(o, array->Get(i));
+        }
+        return;
+    }
+    case ValueType::kMap: {
+        const MAPTYPE& map = ((const MapObject*)val.GetObject())->_map;
+        WriteVarint(o, map.size());
+        for (MAPTYPE::const_iterator iter = map.begin(); iter != map.end(); iter++) {
+            WriteValue(o, iter->first);
+            WriteValue(o, iter->second);
+        }
+        return;
+    }
+    default:
+        throw RuntimeException("const of type " + val.TypeName() + " can't be serialized");
+    }
+}
+
+static Value ReadValue(ScriptReader& reader) {
+    unsigned char type = reader.ReadByte();
+    switch (type) {
+    case ValueType::kNULL:
+        return Value();
+    case ValueType::kInteger:
+        return Value((Value::INTVAR)reader.ReadSignedVarint());
+    case ValueType::kFloat:
+        return Value(reader.ReadDouble());
+    case ValueType::kString:
+        return Value(reader.ReadString());
+    case ValueType::kBytes:
+        return Value::make_bytes(reader.ReadString());
+    case ValueType::kArray: {
+        Value result = Value::make_array();
+        uint64_t count = reader.ReadCount();
+        for (uint64_t i = 0; i < count; i++) {
+            result.Array()->Push(ReadValue(reader));
+        }
+        return result;
+    }
+    case ValueType::kMap: {
+        Value result = Value::make_map();
+        uint64_t count = reader.ReadCount();
+        for (uint64_t i = 0; i < count; i++) {
+            Value key = ReadValue(reader);
+            result._map()[key] = ReadValue(reader);
+        }
+        return result;
+    }
+    default:
+        throw RuntimeException("compiled script has an unknown const type");
+    }
+}
+
+//the key of an instruction is its position in the table,so it's not written
+void Instruction::WriteToStream(std::ostream& o, const std::map<Symbol, int>& names) const {
+    o.put(OpCode);
+    WriteVarint(o, names.find(Name)->second);
+    WriteVarint(o, Refs.size());
+    for (size_t i = 0; i < Refs.size(); i++) {
+        WriteVarint(o, Refs[i]);
+    }
+}
+
+void Instruction::ReadFromStream(ScriptReader& reader, const std::vector<Symbol>& names) {
+    OpCode = reader.ReadByte();
+    uint64_t name = reader.ReadVarint();
+    if (name >= names.size()) {
+        throw RuntimeException("compiled script is corrupted");
+    }
+    Name = names[name];
+    uint64_t count = reader.ReadCount();
+    Refs.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        Refs[i] = reader.ReadVarint();
+    }
+}
+
+void Script::WriteToStream(std::ostream& o) const {
+    std::map<Symbol, int> names;
+    std::vector<Symbol> nameTable;
+    for (size_t i = 0; i < mInstructionTable.size(); i++) {
+        Symbol name = mInstructionTable[i]->Name;
+        if (names.find(name) == names.end()) {
+            names[name] = nameTable.size();
+            nameTable.push_back(name);
+        }
+    }
+    o.write(kScriptMagic, sizeof(kScriptMagic));
+    WriteInt(o, kFormatVersion);
+    WriteInt(o, kByteOrderMark);
+    WriteVarint(o, mInstructionBase);
+    WriteVarint(o, mConstBase);
+    WriteVarint(o, EntryPoint->key);
+    WriteVarint(o, nameTable.size());
+    for (size_t i = 0; i < nameTable.size(); i++) {
+        WriteString(o, SymbolTable::Name(nameTable[i]));
+    }
+    WriteVarint(o, mInstructionTable.size());
+    for (size_t i = 0; i < mInstructionTable.size(); i++) {
+        mInstructionTable[i]->WriteToStream(o, names);
+    }
+    WriteVarint(o, mConstTable.size());
+    for (size_t i = 0; i < mConstTable.size(); i++) {
+        WriteValue(o, mConstTable[i]);
+    }
+}
+
+void Script::ReadFromStream(ScriptReader& reader) {
+    if (EntryPoint != NULL || mInstructionTable.size() != 1 || mConstTable.size() != 1) {
+        throw RuntimeException("script already has instructions");
+    }
+    char magic[sizeof(kScriptMagic)];
+    for (size_t i = 0; i < sizeof(magic); i++) {
+        magic[i] = reader.ReadByte();
+    }
+    if (memcmp(magic, kScriptMagic, sizeof(magic)) != 0) {
+        throw RuntimeException("not a compiled script");
+    }
+    if (reader.ReadInt() != kFormatVersion) {
+        throw RuntimeException("compiled script version not supported");
+    }
+    if (reader.ReadInt() != kByteOrderMark) {
+        throw RuntimeException("compiled script byte order not supported");
+    }
+    //scripts are never relocated,keys start at 0
+    if (reader.ReadVarint() != 0 || reader.ReadVarint() != 0) {
+        throw RuntimeException("compiled script is corrupted");
+    }
+    Instruction::keyType entry = reader.ReadVarint();
+    std::vector<Symbol> names(reader.ReadCount());
+    for (size_t i = 0; i < names.size(); i++) {
+        names[i] = SymbolTable::Intern(reader.ReadString());
+    }
+    uint64_t count = reader.ReadCount();
+    if (count < 1) {
+        throw RuntimeException("compiled script is corrupted");
+    }
+    //the NULL instruction and const of the constructor are in the tables read
+    delete mInstructionTable[0];
+    mInstructionTable.clear();
+    mConstTable.clear();
+    for (uint64_t i = 0; i < count; i++) {
+        Instruction* ins = new Instruction();
+        mInstructionTable.push_back(ins);
+        ins->ReadFromStream(reader, names);
+        ins->key = mInstructionBase + i;
+    }
+    count = reader.ReadCount();
+    for (uint64_t i = 0; i < count; i++) {
+        mConstTable.push_back(ReadValue(reader));
+    }
+    EntryPoint = (Instruction*)GetInstruction(entry);
+    Validate();
+}
+
+//ref count range each opcode is built with by the parser,false for an unknown opcode
+static bool GetRefCount(Instructions::Type op, size_t& min, size_t& max) {
+    if (op >= Instructions::kADD && op <= Instructions::kMAXArithmeticOP) {
+        min = (op == Instructions::kNOT || op == Instructions::kBNG) ? 1 : 2;
+        max = 2;
+        return true;
+    }
+    if (op >= Instructions::kWrite && op <= Instructions::kRSHIFTWrite) {
+        min = 0;
+        max = 1;
+        return true;
+    }
+    switch (op) {
+    case Instructions::kNop:
+    case Instructions::kReadVar:
+    case Instructions::kBREAKStatement:
+    case Instructions::kCONTINUEStatement:
+        min = max = 0;
+        return true;
+    case Instructions::kConst:
+    case Instructions::kConstObject:
+    case Instructions::kRETURNStatement:
+    case Instructions::kCreateMap:
+    case Instructions::kCreateArray:
+    case Instructions::kMinus:
+        min = max = 1;
+        return true;
+    case Instructions::kNewVar:
+    case Instructions::kCallFunction:
+        min = 0;
+        max = 1;
+        return true;
+    case Instructions::kNewFunction:
+    case Instructions::kReadAt:
+        min = 1;
+        max = 2;
+        return true;
+    case Instructions::kWriteAt:
+    case Instructions::kContitionExpression:
+    case Instructions::kSlice:
+    case Instructions::kForInStatement:
+        min = max = 2;
+        return true;
+    case Instructions::kIFStatement:
+    case Instructions::kSwitchCaseStatement:
+        min = max = 3;
+        return true;
+    case Instructions::kFORStatement:
+        min = max = 4;
+        return true;
+    case Instructions::kGroup:
+        min = 0;
+        max = (size_t)-1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+//lists are walked by the compiler without checking their items,so they must be
+//real lists and not a const whose ref is a key into the const table
+static const Instruction* CheckList(const Script* script, Instruction::keyType key) {
+    const Instruction* list = script->GetInstruction(key);
+    if (list->OpCode != Instructions::kNop && list->OpCode != Instructions::kGroup) {
+        throw RuntimeException("compiled script is corrupted");
+    }
+    return list;
+}
+
+//elsif,case and map item lists hold items of a fixed shape
+static void CheckItems(const Script* script, Instruction::keyType key, Instructions::Type itemOp) {
+    InstructionList items = script->GetInstructions(CheckList(script, key)->Refs);
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i]->OpCode != itemOp || items[i]->Refs.size() != 2) {
+            throw RuntimeException("compiled script is corrupted");
+        }
+    }
+}
+
+//the parser stack is as deep as this,so no source script nests deeper
+static const size_t kMaxInstructionDepth = 10000;
+
+//the compiler indexes refs and recurses without checks,so the loaded tables must
+//look like what the parser builds:known opcodes with the refs they need,refs in
+//range and a tree without cycles starting at the entry point
+void Script::Validate() const {
+    for (size_t i = 0; i < mInstructionTable.size(); i++) {
+        const Instruction* ins = mInstructionTable[i];
+        size_t min = 0, max = 0;
+        if (!GetRefCount(ins->OpCode, min, max) || ins->Refs.size() < min ||
+            ins->Refs.size() > max) {
+            throw RuntimeException("compiled script is corrupted");
+        }
+        if (ins->IsConst()) {
+            GetConstValue(ins->Refs[0]);
+            continue;
+        }
+        for (size_t j = 0; j < ins->Refs.size(); j++) {
+            GetInstruction(ins->Refs[j]);
+        }
+        switch (ins->OpCode) {
+        case Instructions::kIFStatement:
+            if (GetInstruction(ins->Refs[0])->OpCode != Instructions::kContitionExpression) {
+                throw RuntimeException("compiled script is corrupted");
+            }
+            CheckItems(this, ins->Refs[1], Instructions::kContitionExpression);
+            break;
+        case Instructions::kSwitchCaseStatement: {
+            CheckItems(this, ins->Refs[1], Instructions::kGroup);
+            InstructionList cases = GetInstructions(GetInstruction(ins->Refs[1])->Refs);
+            for (size_t j = 0; j < cases.size(); j++) {
+                CheckList(this, cases[j]->Refs[0]);
+            }
+        } break;
+        case Instructions::kCreateMap:
+            CheckItems(this, ins->Refs[0], Instructions::kGroup);
+            break;
+        case Instructions::kCreateArray:
+            CheckList(this, ins->Refs[0]);
+            break;
+        case Instructions::kCallFunction:
+            if (ins->Refs.size()) {
+                CheckList(this, ins->Refs[0]);
+            }
+            break;
+        case Instructions::kForInStatement:
+            if (ins->GetName().find(',') == std::string::npos) {
+                throw RuntimeException("compiled script is corrupted");
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    //depth first from the entry point,meeting an instruction which is still on the
+    //path means a cycle.shared subtrees are fine and walked once
+    enum { kUnvisited = 0, kOnPath, kDone };
+    std::vector<char> state(mInstructionTable.size(), kUnvisited);
+    std::vector<std::pair<const Instruction*, size_t> > path;
+    path.push_back(std::make_pair(EntryPoint, (size_t)0));
+    state[EntryPoint->key] = kOnPath;
+    while (path.size()) {
+        const Instruction* ins = path.back().first;
+        size_t next = path.back().second++;
+        if (ins->IsConst() || next == ins->Refs.size()) {
+            state[ins->key] = kDone;
+            path.pop_back();
+            continue;
+        }
+        Instruction::keyType key = ins->Refs[next];
+        if (state[key] == kOnPath || path.size() >= kMaxInstructionDepth) {
+            throw RuntimeException("compiled script is corrupted");
+        }
+        if (state[key] == kUnvisited) {
+            state[key] = kOnPath;
+            path.push_back(std::make_pair(GetInstruction(key), (size_t)0));
+        }
+    }
+}
+
+} // namespace Interpreter
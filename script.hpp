@@ -1,5 +1,6 @@
 #pragma once
 #include <assert.h>
+#include <stdio.h>
 
 #include <list>
 #include <map>
@@ -8,6 +9,7 @@
 #include <vector>
 
 #include "exception.hpp"
+#include "symbol.hpp"
 #include "value.hpp"
 
 namespace Interpreter {
@@ -36,6 +38,8 @@ const Type kSlice = CODE_BASE + 18;
 const Type kForInStatement = CODE_BASE + 19;
 const Type kSwitchCaseStatement = CODE_BASE + 20;
 const Type kMinus = CODE_BASE+21;
+//map or array literal built by the optimizer,Refs[0] is a const key like kConst
+const Type kConstObject = CODE_BASE + 22;
 
 const Type kArithmeticOP = 40;
 const Type kADD = kArithmeticOP + 1;
@@ -74,87 +78,92 @@ const Type kLSHIFTWrite = 80;
 const Type kRSHIFTWrite = 81;
 }; // namespace Instructions
 
+//reads the binary form written by Script::WriteToStream from memory,
+//reading past the end throws RuntimeException
+class ScriptReader {
+public:
+    ScriptReader(const char* data, size_t size) : mPos(data), mEnd(data + size) {}
+    unsigned char ReadByte();
+    int32_t ReadInt();
+    //counts,keys and integers are stored as variable length integers
+    uint64_t ReadVarint();
+    int64_t ReadSignedVarint();
+    //count of the elements which follow,each of them takes one byte at least
+    uint64_t ReadCount();
+    double ReadDouble();
+    std::string ReadString();
+
+private:
+    void Read(void* out, size_t size);
+
+private:
+    const char* mPos;
+    const char* mEnd;
+};
+
 class Instruction {
 public:
     typedef int keyType;
     Instructions::Type OpCode;
     keyType key;
-    std::string Name;
+    //identifier of variables and functions,type name of lists
+    Symbol Name;
     std::vector<keyType> Refs;
 
-    void WriteToStream(std::ostream& o) {
-        o << OpCode;
-        o << key;
-        o << (unsigned char)Name.size();
-        o.write(Name.c_str(), Name.size());
-        o << (int)Refs.size();
-        std::vector<keyType>::iterator iter = Refs.begin();
-        while (iter != Refs.end()) {
-            o << *iter;
-            iter++;
-        }
-    }
+    const std::string& GetName() const { return SymbolTable::Name(Name); }
 
-    void ReadFromStream(std::iostream& stream) {
-        char name_size = 0;
-        int count = 0;
-        keyType value = 0;
-        stream >> OpCode;
-        stream >> key;
-        stream >> name_size;
-        char* buf = new char[name_size];
-        stream.read(buf, name_size);
-        Name.assign(buf, name_size);
-        delete[] buf;
-        stream >> count;
-        for (int i = 0; i < count; i++) {
-            stream >> value;
-            Refs.push_back(value);
-        }
-    }
+    //names are written as indexes into the name table of the script
+    void WriteToStream(std::ostream& o, const std::map<Symbol, int>& names) const;
+    void ReadFromStream(ScriptReader& reader, const std::vector<Symbol>& names);
 
 public:
-    Instruction() : OpCode(Instructions::kNop), key(0) {}
-    Instruction(Instruction* one) : key(0) { Refs.push_back(one->key); }
-    Instruction(Instruction* one, Instruction* tow) : key(0) {
+    Instruction() : OpCode(Instructions::kNop), key(0), Name(SymbolTable::kEmpty) {}
+    Instruction(Instruction* one) : key(0), Name(SymbolTable::kEmpty) { Refs.push_back(one->key); }
+    Instruction(Instruction* one, Instruction* tow) : key(0), Name(SymbolTable::kEmpty) {
         Refs.push_back(one->key);
         Refs.push_back(tow->key);
     }
-    Instruction(Instruction* one, Instruction* tow, Instruction* three) : key(0) {
+    Instruction(Instruction* one, Instruction* tow, Instruction* three)
+            : key(0), Name(SymbolTable::kEmpty) {
         Refs.push_back(one->key);
         Refs.push_back(tow->key);
         Refs.push_back(three->key);
     }
     Instruction(Instruction* one, Instruction* tow, Instruction* three, Instruction* four)
-            : key(0) {
+            : key(0), Name(SymbolTable::kEmpty) {
         Refs.push_back(one->key);
         Refs.push_back(tow->key);
         Refs.push_back(three->key);
         Refs.push_back(four->key);
     }
     bool IsNULL() const { return OpCode == Instructions::kNop; }
+    bool IsConst() const {
+        return OpCode == Instructions::kConst || OpCode == Instructions::kConstObject;
+    }
     std::string ToString() const {
         if (OpCode >= Instructions::kADD && OpCode <= Instructions::kMAXArithmeticOP) {
             return "Arithmetic Operation";
         }
         if (OpCode >= Instructions::kWrite && OpCode <= Instructions::kRSHIFTWrite) {
-            return "Update Var:" + Name;
+            return "Update Var:" + GetName();
         }
         switch (OpCode) {
         case Instructions::kNop:
             return "Nop";
         case Instructions::kConst:
             return "Create Const:";
+        case Instructions::kConstObject:
+            return "Create Const Object:";
         case Instructions::kNewVar:
-            return "Create Var:" + Name;
+            return "Create Var:" + GetName();
         case Instructions::kReadVar:
-            return "Read Var:" + Name;
+            return "Read Var:" + GetName();
         case Instructions::kNewFunction:
-            return "Create Function:" + Name;
+            return "Create Function:" + GetName();
         case Instructions::kCallFunction:
-            return "Call Function:" + Name;
+            return "Call Function:" + GetName();
         case Instructions::kGroup:
-            return Name+"(list)";
+            return GetName() + "(list)";
         case Instructions::kContitionExpression:
             return "ContitionExpression";
         case Instructions::kIFStatement:
@@ -188,77 +197,61 @@ public:
     }
 };
 
+class Script;
+
+//non-owning view of the instructions referenced by a key list,
+//the key list must outlive the view
+class InstructionList {
+public:
+    InstructionList(const Script* script, const std::vector<Instruction::keyType>& keys)
+            : mScript(script), mKeys(&keys) {}
+    size_t size() const { return mKeys->size(); }
+    const Instruction* operator[](size_t index) const;
+
+private:
+    const Script* mScript;
+    const std::vector<Instruction::keyType>* mKeys;
+};
+
 class Script : public CRefCountedThreadSafe<Script> {
 public:
     Instruction* EntryPoint;
     std::string Name;
     explicit Script(std::string name) : Name(name) {
         EntryPoint = NULL;
-        mInstructionKey = 1;
-        mConstKey = 1;
-        mInstructionTable[0] = new Instruction();
+        mInstructionTable.push_back(new Instruction());
+        mConstTable.push_back(Value());
         mInstructionBase = 0;
         mConstBase = 0;
     }
     ~Script() {
-        for (std::map<Instruction::keyType, Instruction*>::iterator iter =
-                     mInstructionTable.begin();
-             iter != mInstructionTable.end(); iter++) {
-            delete (iter->second);
+        for (size_t i = 0; i < mInstructionTable.size(); i++) {
+            delete mInstructionTable[i];
         }
         mInstructionTable.clear();
         mConstTable.clear();
     }
 
 protected:
-    Instruction::keyType mInstructionKey;
-    Instruction::keyType mConstKey;
     Instruction::keyType mInstructionBase;
     Instruction::keyType mConstBase;
-    std::map<Instruction::keyType, Instruction*> mInstructionTable;
-    std::map<Instruction::keyType, Value> mConstTable;
+    //instructions and consts are stored flat,the key of an element is its index plus the base
+    std::vector<Instruction*> mInstructionTable;
+    std::vector<Value> mConstTable;
 
 public:
-    void RelocateInstruction(Instruction::keyType newbase, Instruction::keyType newConstbase) {
-        if (mInstructionBase != 0 || mConstBase != 0) {
-            throw RuntimeException("script can only Relocate once");
-        }
-        for (std::map<Instruction::keyType, Instruction*>::iterator iter =
-                     mInstructionTable.begin();
-             iter != mInstructionTable.end(); iter++) {
-            Instruction* ptr = iter->second;
-            if (ptr->OpCode == Instructions::kConst) {
-                assert(ptr->Refs[0] < mConstKey);
-                ptr->Refs[0] = ptr->Refs[0] + newConstbase;
-            } else {
-                for (size_t i = 0; i < ptr->Refs.size(); i++) {
-                    assert(ptr->Refs[i] < mInstructionKey);
-                    ptr->Refs[i] = ptr->Refs[i] + newbase;
-                }
-            }
-            ptr->key += newbase;
-        }
-        mInstructionBase = newbase;
-        mConstBase = newConstbase;
+    Instruction::keyType GetNextInstructionKey() const {
+        return mInstructionBase + (Instruction::keyType)mInstructionTable.size();
     }
-
-    bool IsContainInstruction(Instruction::keyType key) {
-        return key >= mInstructionBase && key < GetNextInstructionKey();
-    }
-    bool IsContainConst(Instruction::keyType key) {
-        return key >= mConstBase && key < GetNextConstKey();
+    Instruction::keyType GetNextConstKey() const {
+        return mConstBase + (Instruction::keyType)mConstTable.size();
     }
-    Instruction::keyType GetNextInstructionKey() { return mInstructionBase + mInstructionKey; }
-    Instruction::keyType GetNextConstKey() { return mConstBase + mConstKey; }
 
 public:
     Instruction* NewGroup(Instruction* element) {
         Instruction* ins = new Instruction(element);
         ins->OpCode = Instructions::kGroup;
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
+        return AddInstruction(ins);
     }
     Instruction* AddToGroup(Instruction* group, Instruction* element) {
         assert(group->OpCode == Instructions::kGroup);
@@ -266,87 +259,44 @@ public:
         return group;
     }
     Instruction* NULLInstruction() { return mInstructionTable[0]; }
-    Instruction* NewInstruction() {
-        Instruction* ins = new Instruction();
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
-    }
-    Instruction* NewInstruction(Instruction* one) {
-        Instruction* ins = new Instruction(one);
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
-    }
+    Instruction* NewInstruction() { return AddInstruction(new Instruction()); }
+    Instruction* NewInstruction(Instruction* one) { return AddInstruction(new Instruction(one)); }
     Instruction* NewInstruction(Instruction* one, Instruction* tow) {
-        Instruction* ins = new Instruction(one, tow);
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
+        return AddInstruction(new Instruction(one, tow));
     }
     Instruction* NewInstruction(Instruction* one, Instruction* tow, Instruction* three) {
-        Instruction* ins = new Instruction(one, tow, three);
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
+        return AddInstruction(new Instruction(one, tow, three));
     }
     Instruction* NewInstruction(Instruction* one, Instruction* tow, Instruction* three,
                                 Instruction* four) {
-        Instruction* ins = new Instruction(one, tow, three, four);
-        ins->key = mInstructionKey;
-        mInstructionKey++;
-        mInstructionTable[ins->key] = ins;
-        return ins;
+        return AddInstruction(new Instruction(one, tow, three, four));
     }
     //TODO use const value pool
-    Instruction* NewConst(const std::string& value) {
-        Value val = Value(value);
-        Instruction::keyType key = mConstKey;
-        mConstKey++;
-        mConstTable[key] = val;
-        Instruction* ins = NewInstruction();
-        ins->OpCode = Instructions::kConst;
-        ins->Refs.push_back(key);
-        return ins;
-    }
-    Instruction* NewConst(long value) {
-        Value val = Value(value);
-        Instruction::keyType key = mConstKey;
-        mConstKey++;
-        mConstTable[key] = val;
-        Instruction* ins = NewInstruction();
-        ins->OpCode = Instructions::kConst;
-        ins->Refs.push_back(key);
-        return ins;
-    }
-    Instruction* NewConst(double value) {
-        Value val = Value(value);
-        Instruction::keyType key = mConstKey;
-        mConstKey++;
-        mConstTable[key] = val;
-        Instruction* ins = NewInstruction();
-        ins->OpCode = Instructions::kConst;
-        ins->Refs.push_back(key);
-        return ins;
-    }
-
-    Value GetConstValue(Instruction::keyType key) { return mConstTable[key - mConstBase]; }
+    Instruction* NewConst(const std::string& value) { return AddConst(Value(value)); }
+    Instruction* NewConst(long value) { return AddConst(Value(value)); }
+    Instruction* NewConst(double value) { return AddConst(Value(value)); }
+    Instruction* NewConst(const Value& value) { return AddConst(value); }
 
-    const Instruction* GetInstruction(Instruction::keyType key) {
-        return mInstructionTable[key - mInstructionBase];
+    Value GetConstValue(Instruction::keyType key) const {
+        Instruction::keyType index = key - mConstBase;
+        if (index < 0 || index >= (Instruction::keyType)mConstTable.size()) {
+            throw RuntimeException("unknown const key");
+        }
+        return mConstTable[index];
     }
 
-    std::vector<const Instruction*> GetInstructions(std::vector<Instruction::keyType> keys) {
-        std::vector<const Instruction*> result;
-        for (std::vector<Instruction::keyType>::iterator iter = keys.begin(); iter != keys.end();
-             iter++) {
-            result.push_back(mInstructionTable[*iter - mInstructionBase]);
+    const Instruction* GetInstruction(Instruction::keyType key) const {
+        Instruction::keyType index = key - mInstructionBase;
+        if (index < 0 || index >= (Instruction::keyType)mInstructionTable.size()) {
+            char buf[16] = {0};
+            snprintf(buf, 16, "%d", key);
+            throw RuntimeException(std::string("unknown instruction key:") + buf);
         }
-        return result;
+        return mInstructionTable[index];
+    }
+
+    InstructionList GetInstructions(const std::vector<Instruction::keyType>& keys) const {
+        return InstructionList(this, keys);
     }
 
     /*
@@ -392,7 +342,7 @@ public:
             o << "}" << std::endl;
         } break;
         case Instructions::kCallFunction:
-            o << ins->Name << "(";
+            o << ins->GetName() << "(";
             RestoreToCode(o,GetInstruction(ins->Refs[0]));
             o << ")";
             return;
@@ -428,44 +378,51 @@ public:
             return;
         }
     }
-    std::string DumpInstruction(const Instruction* ins, std::string prefix) {
+    std::string DumpInstruction(const Instruction* ins, std::string prefix) const {
         std::stringstream stream;
         stream << prefix;
-        if (ins->OpCode == Instructions::kConst) {
+        if (ins->IsConst()) {
             stream << ins->key << " " << ins->ToString() << GetConstValue(ins->Refs[0]).ToString()
                    << std::endl;
             return stream.str();
         }
         stream << ins->key << " " << ins->ToString() << std::endl;
         if (ins->Refs.size() > 0) {
-            std::vector<const Instruction*> subs = GetInstructions(ins->Refs);
-            std::vector<const Instruction*>::iterator iter = subs.begin();
-            while (iter != subs.end()) {
-                stream << DumpInstruction(*iter, prefix + "\t");
-                iter++;
+            InstructionList subs = GetInstructions(ins->Refs);
+            for (size_t i = 0; i < subs.size(); i++) {
+                stream << DumpInstruction(subs[i], prefix + "\t");
             }
         }
         return stream.str();
     }
-    void WriteToStream(std::ostream& o) {
-        o << EntryPoint->key;
-        o << (long)mInstructionTable.size();
-        o << (long)mConstTable.size();
-        for (std::map<Instruction::keyType, Instruction*>::iterator iter =
-                     mInstructionTable.begin();
-             iter != mInstructionTable.end(); iter++) {
-            iter->second->WriteToStream(o);
-        }
-    }
-
-    void ReadFromStream(std::iostream& stream) {}
+    //binary form of the instruction and const tables,loading it needs no parsing.
+    //the layout is native endian and checked by magic,version and byte order
+    static const int kFormatVersion = 1;
+    void WriteToStream(std::ostream& o) const;
+    //only a script without instructions can be read into,what's read is checked
+    //to be a tree the compiler can walk
+    void ReadFromStream(ScriptReader& reader);
 
 protected:
+    void Validate() const;
+    Instruction* AddInstruction(Instruction* ins) {
+        ins->key = GetNextInstructionKey();
+        mInstructionTable.push_back(ins);
+        return ins;
+    }
+    Instruction* AddConst(const Value& val) {
+        Instruction::keyType key = GetNextConstKey();
+        mConstTable.push_back(val);
+        Instruction* ins = NewInstruction();
+        ins->OpCode = Instructions::kConst;
+        ins->Refs.push_back(key);
+        return ins;
+    }
     std::string JoinRefsName(const Instruction* ins) {
         std::string refs = "";
-        std::vector<const Instruction*> list = GetInstructions(ins->Refs);
+        InstructionList list = GetInstructions(ins->Refs);
         for (size_t i = 0; i < list.size(); i++) {
-            refs += list[i]->Name;
+            refs += list[i]->GetName();
             refs += ",";
         }
         if (refs.size() == 0) {
@@ -474,4 +431,8 @@ protected:
         return refs.substr(0, refs.size() - 1);
     }
 };
+
+inline const Instruction* InstructionList::operator[](size_t index) const {
+    return mScript->GetInstruction((*mKeys)[index]);
+}
 } // namespace Interpreter
\ No newline at end of file
@@ -1,3 +1,4 @@
+%define api.pure full
 %parse-param {Interpreter::Parser * parser}
 %lex-param {Interpreter::Parser * parser}
 %{
@@ -9,7 +10,6 @@
 %{
 using Instruction= Interpreter::Instruction;
 // https://stackoverflow.com/questions/23717039/generating-a-compiler-from-lex-and-yacc-grammar
-int yylex(Interpreter::Parser * parser);
 void yyerror(Interpreter::Parser * parser,const char *s);
 %}
 %union {
@@ -18,6 +18,9 @@ void yyerror(Interpreter::Parser * parser,const char *s);
     double      value_double; 
     Instruction* object;
 };
+%{
+int yylex(YYSTYPE* lval, Interpreter::Parser * parser);
+%}
 
 %token  <identifier>VAR FUNCTION FOR IF ELIF ELSE ADD SUB MUL DIV MOD ASSIGN
         EQ NE GT GE LT LE LP RP LC RC SEMICOLON IDENTIFIER 
@@ -0,0 +1,66 @@
+#include "scriptcache.hpp"
+
+#include <sys/stat.h>
+
+namespace Interpreter {
+
+//st_mtime only has seconds,an edit in the same second that keeps the size would
+//go unnoticed
+bool ScriptCache::GetFileStamp(const std::string& path, FileStamp& stamp) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    stamp.ModifyTime = info.st_mtimespec;
+#else
+    stamp.ModifyTime = info.st_mtim;
+#endif
+    stamp.Size = info.st_size;
+    return true;
+}
+
+bool ScriptCache::IsSameStamp(const FileStamp& one, const FileStamp& other) {
+    return one.ModifyTime.tv_sec == other.ModifyTime.tv_sec &&
+           one.ModifyTime.tv_nsec == other.ModifyTime.tv_nsec && one.Size == other.Size;
+}
+
+scoped_refptr<Script> ScriptCache::Load(const std::string& path) {
+    FileStamp requested;
+    if (!GetFileStamp(path, requested)) {
+        return NULL;
+    }
+    Entry cached;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        std::map<std::string, Entry>::iterator iter = mScripts.find(path);
+        if (iter != mScripts.end() && IsSameStamp(iter->second.Requested, requested)) {
+            cached = iter->second;
+        }
+    }
+    if (cached.Loaded != NULL) {
+        FileStamp loaded;
+        if (cached.LoadedPath == path ||
+            (GetFileStamp(cached.LoadedPath, loaded) && IsSameStamp(cached.LoadedStamp, loaded))) {
+            return cached.Loaded;
+        }
+    }
+    //parse without the lock,other paths are served meanwhile
+    Entry entry;
+    entry.Requested = requested;
+    entry.Loaded = mLoader(path, &entry.LoadedPath);
+    if (entry.Loaded == NULL) {
+        return NULL;
+    }
+    if (entry.LoadedPath.empty() || entry.LoadedPath == path) {
+        entry.LoadedPath = path;
+        entry.LoadedStamp = requested;
+    } else if (!GetFileStamp(entry.LoadedPath, entry.LoadedStamp)) {
+        return entry.Loaded;
+    }
+    std::lock_guard<std::mutex> guard(mLock);
+    mScripts[path] = entry;
+    return entry.Loaded;
+}
+
+} // namespace Interpreter
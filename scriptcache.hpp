@@ -0,0 +1,46 @@
+#pragma once
+#include <sys/types.h>
+#include <time.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "script.hpp"
+
+namespace Interpreter {
+
+//parsed scripts shared by every executor of the process.a script is never changed once
+//it's parsed,so executors compile the cached one instead of parsing the file again.
+//an entry is used while the modify time and size of the requested file,and of the
+//file actually loaded for it (a compiled .osc beside a .sc),are unchanged
+class ScriptCache {
+public:
+    //loadedPath is set to the file the script was read from
+    typedef scoped_refptr<Script> (*Loader)(const std::string& path, std::string* loadedPath);
+
+    explicit ScriptCache(Loader loader) : mLoader(loader) {}
+    //NULL when the file can't be loaded,failures are not cached
+    scoped_refptr<Script> Load(const std::string& path);
+
+private:
+    struct FileStamp {
+        struct timespec ModifyTime;
+        off_t Size;
+    };
+    static bool GetFileStamp(const std::string& path, FileStamp& stamp);
+    static bool IsSameStamp(const FileStamp& one, const FileStamp& other);
+
+    struct Entry {
+        FileStamp Requested;
+        std::string LoadedPath;
+        FileStamp LoadedStamp;
+        scoped_refptr<Script> Loaded;
+    };
+    Loader mLoader;
+    std::mutex mLock;
+    std::map<std::string, Entry> mScripts;
+    DISALLOW_COPY_AND_ASSIGN(ScriptCache);
+};
+
+} // namespace Interpreter
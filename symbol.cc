@@ -0,0 +1,52 @@
+#include "symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "exception.hpp"
+
+namespace Interpreter {
+
+namespace {
+//names are kept in a deque so the strings never move while the table grows
+struct SymbolStorage {
+    std::mutex Lock;
+    std::deque<std::string> Names;
+    std::unordered_map<std::string, Symbol> Ids;
+    SymbolStorage() {
+        Names.push_back("");
+        Ids[""] = SymbolTable::kEmpty;
+    }
+};
+
+//created on first use,symbols are interned while other globals are initialized
+SymbolStorage& Storage() {
+    static SymbolStorage* storage = new SymbolStorage();
+    return *storage;
+}
+} // namespace
+
+Symbol SymbolTable::Intern(const std::string& name) {
+    SymbolStorage& storage = Storage();
+    std::lock_guard<std::mutex> guard(storage.Lock);
+    std::unordered_map<std::string, Symbol>::iterator iter = storage.Ids.find(name);
+    if (iter != storage.Ids.end()) {
+        return iter->second;
+    }
+    Symbol symbol = storage.Names.size();
+    storage.Names.push_back(name);
+    storage.Ids[name] = symbol;
+    return symbol;
+}
+
+const std::string& SymbolTable::Name(Symbol symbol) {
+    SymbolStorage& storage = Storage();
+    std::lock_guard<std::mutex> guard(storage.Lock);
+    if (symbol >= storage.Names.size()) {
+        throw RuntimeException("unknown symbol");
+    }
+    return storage.Names[symbol];
+}
+
+} // namespace Interpreter
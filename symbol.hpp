@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+
+namespace Interpreter {
+
+//id of an interned identifier,equal names always get the same id so the runtime
+//compares names as integers
+typedef uint32_t Symbol;
+
+//process wide table of identifiers,ids are never released and the name of an id
+//stays valid until exit
+class SymbolTable {
+public:
+    //the empty name,default of every instruction
+    static const Symbol kEmpty = 0;
+
+    static Symbol Intern(const std::string& name);
+    static const std::string& Name(Symbol symbol);
+};
+
+} // namespace Interpreter
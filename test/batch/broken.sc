@@ -0,0 +1,3 @@
+#a syntax error,the batch test checks the parse error is kept with this job
+var a = 1;
+var b = (a + ;
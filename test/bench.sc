@@ -0,0 +1,29 @@
+#name lookup heavy workload,time it with: time Interpreter test/bench.sc
+#calls named functions,reads globals and local variables and map keys in a loop
+
+var bench_scale = 3;
+var bench_table = {"alpha":1,"beta":2,"gamma":3,"delta":4};
+
+func bench_add(a,b){
+    return a + b;
+}
+
+func bench_lookup(name){
+    return bench_table[name] * bench_scale;
+}
+
+func bench_run(count){
+    var total = 0;
+    var keys = ["alpha","beta","gamma","delta"];
+    var key;
+    for(var i = 0; i < count; i++){
+        key = keys[i % 4];
+        total = bench_add(total,bench_lookup(key));
+        if(HasKey(bench_table,key)){
+            total += 1;
+        }
+    }
+    return total;
+}
+
+Println(bench_run(1000000));
@@ -0,0 +1,17 @@
+#array workload,time it and watch its peak memory with:
+#/usr/bin/time -v Interpreter test/bench_array.sc (-l on macOS)
+#appends 1M integers to one array,then reads them back
+
+func bench_run(count){
+    var list = [];
+    for(var i = 0; i < count; i++){
+        list = append(list,i);
+    }
+    var total = 0;
+    for(var j = 0; j < len(list); j++){
+        total += list[j];
+    }
+    return total;
+}
+
+Println(bench_run(1000000));
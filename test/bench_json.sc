@@ -0,0 +1,26 @@
+#serializer workload,time it with: time Interpreter test/bench_json.sc
+#encodes a map of 2000 maps of 100 string entries each,200k entries in all,five times
+
+func bench_build(groups,entries){
+    var table = {"groups":groups};
+    var group;
+    for(var i = 0; i < groups; i++){
+        group = {"index":"group" + ToString(i)};
+        for(var j = 1; j < entries; j++){
+            group["key" + ToString(j)] = "value " + ToString(j);
+        }
+        table["group" + ToString(i)] = group;
+    }
+    return table;
+}
+
+func bench_run(count){
+    var root = bench_build(2000,100);
+    var size = 0;
+    for(var i = 0; i < count; i++){
+        size += len(JSONEncode(root));
+    }
+    return size;
+}
+
+Println(bench_run(5));
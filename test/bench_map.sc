@@ -0,0 +1,25 @@
+#map workload,time it with: time Interpreter test/bench_map.sc
+#fills a map with 100k integer keys,looks each up three times,then reads the keys of a
+#small map of response headers 100k times
+
+func bench_run(count){
+    #an empty {} is an array,a literal with a key makes a map
+    var table = {"size":count};
+    for(var i = 0; i < count; i++){
+        table[i] = i * 2;
+    }
+    var total = 0;
+    for(var pass = 0; pass < 3; pass++){
+        for(var j = 0; j < count; j++){
+            total += table[j];
+        }
+    }
+    var headers = {"Content-Type":1,"Content-Length":2,"Connection":3,"Date":4,"Server":5};
+    var names = ["Content-Type","Content-Length","Connection","Date","Server"];
+    for(var k = 0; k < count; k++){
+        total += headers[names[k % 5]];
+    }
+    return total;
+}
+
+Println(bench_run(100000));
@@ -15,7 +15,7 @@ func httplib_test(){
     var query ={"wd":"华尔街之狼","encode":"utf8","time":5000};
     assertEqual(URLQueryEncode(query),"encode=utf8&time=5000&wd=%E5%8D%8E%E5%B0%94%E8%A1%97%E4%B9%8B%E7%8B%BC");
     var resp = HttpGet("https://www.baidu.com/",header);
-    assertEqual(resp["status"],"200");
+    assertEqual(resp["status"],200);
     assertEqual(resp["reason"],"OK");
     assertEqual(resp["version"],"HTTP/1.1");
 
@@ -0,0 +1,147 @@
+#the keep-alive pool against the HTTP server of test/loopback_server.cc,run it with:
+#loopback_server Interpreter test/http_loopback.sc
+
+var _is_test_passed = true;
+func assertEqual(a,b){
+    if(a != b){
+        Println("error here a=",a,"b=",b);
+        _is_test_passed = false;
+    }
+}
+
+var base = "http://127.0.0.1:18710";
+
+#a read of the silent listener runs out of time after a second
+func wait_a_second(){
+    var s = TCPConnect("127.0.0.1",18703,2,false);
+    TCPRead(s,1,1);
+}
+
+#the status of a response,nil when the request failed
+func status_of(response){
+    if(response == nil){
+        return nil;
+    }
+    return response["status"];
+}
+
+#one idle connection per host,the one a request is sent on is always the newest
+HttpSetPoolLimits(16,1);
+
+func test_keepalive_reuse(){
+    var before = HttpPoolStats();
+    var resp;
+    for(var i = 0; i < 5; i++){
+        resp = HttpGet(base + "/reuse");
+        assertEqual(resp["status"],200);
+        assertEqual(string(resp["body"]),"GET /reuse");
+    }
+    var after = HttpPoolStats();
+    assertEqual(after["opened"] - before["opened"],1);
+    assertEqual(after["reused"] - before["reused"],4);
+    assertEqual(after["idle"],1);
+    #a disabled pool opens a connection for each request and keeps none
+    HttpSetPoolLimits(0,0);
+    var stats = HttpPoolStats();
+    assertEqual(stats["idle"],0);
+    assertEqual(status_of(HttpGet(base + "/reuse")),200);
+    assertEqual(status_of(HttpGet(base + "/reuse")),200);
+    stats = HttpPoolStats();
+    assertEqual(stats["opened"] - after["opened"],2);
+    assertEqual(stats["idle"],0);
+    HttpSetPoolLimits(16,1);
+}
+
+test_keepalive_reuse();
+
+func test_server_close(){
+    var before = HttpPoolStats();
+    #a response with Connection: close is never pooled
+    assertEqual(status_of(HttpGet(base + "/close")),200);
+    assertEqual(status_of(HttpGet(base + "/close")),200);
+    var after = HttpPoolStats();
+    assertEqual(after["opened"] - before["opened"],2);
+    assertEqual(after["reused"] - before["reused"],0);
+    assertEqual(after["idle"],0);
+}
+
+test_server_close();
+
+func test_stale_connection(){
+    #the server closes this connection after answering
+    assertEqual(status_of(HttpGet(base + "/drop-idle")),200);
+    var stats = HttpPoolStats();
+    assertEqual(stats["idle"],1);
+    wait_a_second();
+    var before = HttpPoolStats();
+    var resp = HttpGet(base + "/after-idle");
+    assertEqual(resp["status"],200);
+    assertEqual(string(resp["body"]),"GET /after-idle");
+    #the closed connection was found stale and dropped before anything was sent on it
+    var after = HttpPoolStats();
+    assertEqual(after["opened"] - before["opened"],1);
+    assertEqual(after["reused"] - before["reused"],0);
+}
+
+test_stale_connection();
+
+func test_dropped_connection(){
+    #the server closes this connection on its next request without an answer
+    assertEqual(status_of(HttpGet(base + "/drop-next")),200);
+    var before = HttpPoolStats();
+    var resp = HttpGet(base + "/retried");
+    #a GET is sent again on a new connection
+    assertEqual(resp["status"],200);
+    assertEqual(string(resp["body"]),"GET /retried");
+    var after = HttpPoolStats();
+    assertEqual(after["reused"] - before["reused"],1);
+    assertEqual(after["opened"] - before["opened"],1);
+    #a POST may have been carried out already,it fails instead of being sent twice
+    assertEqual(status_of(HttpPost(base + "/drop-next","text/plain","first")),200);
+    assertEqual(HttpPost(base + "/sent-once","text/plain","second"),nil);
+    var stats = HttpPoolStats();
+    assertEqual(stats["opened"] - after["opened"],0);
+    assertEqual(stats["idle"],0);
+    resp = HttpPost(base + "/sent-once","text/plain","third");
+    assertEqual(resp["status"],200);
+    assertEqual(string(resp["body"]),"POST /sent-once");
+}
+
+test_dropped_connection();
+
+#the body is handed over in chunks and never kept in the response
+func test_get_stream(){
+    var total = 0;
+    var resp = HttpGetStream(base + "/stream-gzip",func(chunk){
+        total += len(chunk);
+    });
+    assertEqual(status_of(resp),200);
+    assertEqual(resp["body_size"],100000);
+    assertEqual(total,100000);
+    assertEqual(HasKey(resp,"body"),0);
+    total = 0;
+    resp = HttpGetStream(base + "/stream",func(chunk){
+        total += len(chunk);
+    });
+    assertEqual(resp["body_size"],100000);
+    assertEqual(total,100000);
+    #stopping in the sink aborts the download
+    resp = HttpGetStream(base + "/stream",func(chunk){
+        return false;
+    });
+    assertEqual(resp,nil);
+    resp = HttpGetStream(base + "/stream-gzip","/tmp/onescript_stream_test.txt");
+    assertEqual(resp["body_size"],100000);
+    #a body over the limit fails the request
+    assertEqual(HttpGetStream(base + "/stream-gzip","/tmp/onescript_stream_test.txt",nil,16),nil);
+}
+
+test_get_stream();
+
+HttpSetPoolLimits(16,4);
+
+if(_is_test_passed){
+    Println("all test passed");
+}else{
+    Println("some test not passed");
+}
@@ -0,0 +1,41 @@
+#decodes json in a loop,the batch test runs many copies at once to check the
+#json parser keeps no state between threads
+
+var _is_test_passed = true;
+func assertEqual(a,b){
+    if(a != b){
+        Println("error here a=",a,"b=",b);
+        _is_test_passed = false;
+    }
+}
+
+func test_json_decode_loop(count){
+    #a var declared in the loop body exists already on the next pass
+    var id;
+    var text;
+    var doc;
+    for(var i = 0; i < count; i++){
+        id = ToString(i);
+        text = "{\"id\":" + id + ",\"name\":\"item" + id + "\",\"tags\":[\"a\",\"b\",true,null]";
+        text += ",\"nested\":{\"f\":1.5,\"list\":[" + id + "," + ToString(i+1) + "]}}";
+        doc = JSONDecode(text);
+        assertEqual(doc["id"],i);
+        assertEqual(doc["name"],"item" + id);
+        assertEqual(len(doc["tags"]),4);
+        assertEqual(doc["tags"][1],"b");
+        assertEqual(doc["tags"][2],1);
+        assertEqual(doc["tags"][3],nil);
+        assertEqual(doc["nested"]["f"],1.5);
+        assertEqual(doc["nested"]["list"][1],i+1);
+        #a broken document in between leaves nothing behind
+        assertEqual(JSONDecode("{\"id\":" + id + ","),nil);
+    }
+}
+
+test_json_decode_loop(500);
+
+if(_is_test_passed){
+    Println("all test passed");
+}else{
+    Println("some test not passed");
+}
@@ -0,0 +1,263 @@
+//loopback_server command [args...]
+//serves the fixed loopback ports the network tests talk to,runs the command and exits
+//with its status.
+//  18701 sends a banner as soon as a connection is accepted
+//  18702 echoes what it receives
+//  18703 accepts and never answers
+//  18704 never accepts and its backlog is full,connects to it time out
+//  18710 is a keep-alive HTTP/1.1 server,the path of a request tells what it does:
+//        /close      answers with Connection: close and closes
+//        /drop-idle  answers,then closes the connection while it's idle
+//        /drop-next  answers,then closes the connection on its next request unanswered
+//        /stream     sends kStreamSize bytes of a..z in chunks
+//        /stream-gzip the same body gzip encoded
+//        others      answer with the path and keep the connection
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+static const char kBanner[] = "onescript loopback banner\r\n";
+static const size_t kStreamSize = 100000;
+
+static int Listen(int port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//read until the peer closes
+static void Drain(int fd) {
+    char buffer[4096];
+    while (recv(fd, buffer, sizeof(buffer), 0) > 0) {
+    }
+}
+
+static void ServeBanner(int fd) {
+    send(fd, kBanner, sizeof(kBanner) - 1, 0);
+    Drain(fd);
+    close(fd);
+}
+
+static void ServeEcho(int fd) {
+    char buffer[4096];
+    ssize_t size;
+    while ((size = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        if (send(fd, buffer, size, 0) != size) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void ServeSilent(int fd) {
+    Drain(fd);
+    close(fd);
+}
+
+//the next request of the connection,false when the peer closed first
+static bool ReadRequest(int fd, std::string& pending, std::string& method, std::string& path) {
+    char buffer[4096];
+    size_t end;
+    while ((end = pending.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size <= 0) {
+            return false;
+        }
+        pending.append(buffer, size);
+    }
+    std::string header = pending.substr(0, end + 4);
+    size_t length = 0;
+    std::string lower = header;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    size_t pos = lower.find("\r\ncontent-length:");
+    if (pos != std::string::npos) {
+        length = strtoul(header.c_str() + pos + 17, NULL, 10);
+    }
+    while (pending.size() < header.size() + length) {
+        ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size <= 0) {
+            return false;
+        }
+        pending.append(buffer, size);
+    }
+    pending.erase(0, header.size() + length);
+    size_t space = header.find(' ');
+    method = header.substr(0, space);
+    path = header.substr(space + 1, header.find(' ', space + 1) - space - 1);
+    return true;
+}
+
+static std::string StreamBody() {
+    std::string body(kStreamSize, 'a');
+    for (size_t i = 0; i < body.size(); i++) {
+        body[i] = 'a' + i % 26;
+    }
+    return body;
+}
+
+static std::string Gzip(const std::string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+//a chunked response of the body,in chunks of 4096 bytes
+static bool SendChunked(int fd, const std::string& body, const char* encoding) {
+    std::string resp = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                       "Transfer-Encoding: chunked\r\n";
+    if (encoding != NULL) {
+        resp += std::string("Content-Encoding: ") + encoding + "\r\n";
+    }
+    resp += "\r\n";
+    char size[32];
+    for (size_t pos = 0; pos < body.size(); pos += 4096) {
+        size_t count = std::min((size_t)4096, body.size() - pos);
+        snprintf(size, sizeof(size), "%zx\r\n", count);
+        resp += size + body.substr(pos, count) + "\r\n";
+    }
+    resp += "0\r\n\r\n";
+    return send(fd, resp.data(), resp.size(), 0) == (ssize_t)resp.size();
+}
+
+static void ServeHTTP(int fd) {
+    std::string pending, method, path;
+    bool dropNext = false;
+    while (ReadRequest(fd, pending, method, path) && !dropNext) {
+        if (path == "/stream" || path == "/stream-gzip") {
+            bool gzip = path == "/stream-gzip";
+            if (!SendChunked(fd, gzip ? Gzip(StreamBody()) : StreamBody(),
+                             gzip ? "gzip" : NULL)) {
+                break;
+            }
+            continue;
+        }
+        bool keep = path != "/close";
+        std::string body = method + " " + path;
+        std::string resp = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\n";
+        resp += keep ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        resp += body;
+        if (send(fd, resp.data(), resp.size(), 0) != (ssize_t)resp.size()) {
+            break;
+        }
+        if (!keep || path == "/drop-idle") {
+            break;
+        }
+        dropNext = path == "/drop-next";
+    }
+    close(fd);
+}
+
+typedef void (*Handler)(int fd);
+
+static void AcceptLoop(int listener, Handler handler) {
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        std::thread(handler, fd).detach();
+    }
+}
+
+//connect to port until the accept queue of the listener is full,later SYNs are dropped
+static void FillBacklog(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 8; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage:%s command [args...]\n", argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    struct {
+        int Port;
+        Handler Serve;
+    } services[] = {
+            {18701, ServeBanner},
+            {18702, ServeEcho},
+            {18703, ServeSilent},
+            {18710, ServeHTTP},
+    };
+    for (size_t i = 0; i < sizeof(services) / sizeof(services[0]); i++) {
+        int fd = Listen(services[i].Port, 64);
+        if (fd < 0) {
+            fprintf(stderr, "listen on %d failed:%s\n", services[i].Port, strerror(errno));
+            return 2;
+        }
+        std::thread(AcceptLoop, fd, services[i].Serve).detach();
+    }
+    if (Listen(18704, 0) < 0) {
+        fprintf(stderr, "listen on 18704 failed:%s\n", strerror(errno));
+        return 2;
+    }
+    FillBacklog(18704);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if (pid == 0) {
+        execv(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    //the serving threads are still blocked in accept
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
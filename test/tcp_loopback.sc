@@ -0,0 +1,62 @@
+#TCPConnectMany against the listeners of test/loopback_server.cc,run it with:
+#loopback_server Interpreter test/tcp_loopback.sc
+
+var _is_test_passed = true;
+func assertEqual(a,b){
+    if(a != b){
+        Println("error here a=",a,"b=",b);
+        _is_test_passed = false;
+    }
+}
+
+func test_connect_many_loopback(){
+    var banner = "127.0.0.1:18701";
+    var echo = "127.0.0.1:18702";
+    var silent = "127.0.0.1:18703";
+    var full = "127.0.0.1:18704";
+    var closed = "127.0.0.1:1";
+    var r = TCPConnectMany([banner,echo,silent,full,closed],8,1,"ping\r\n",64);
+    assertEqual(len(r),5);
+
+    #the banner is sent before the probe is read
+    assertEqual(r[banner]["status"],"open");
+    assertEqual(r[banner]["rtt"] >= 0,1);
+    assertEqual(string(r[banner]["banner"]),"onescript loopback banner\r\n");
+
+    #the probe comes back
+    assertEqual(r[echo]["status"],"open");
+    assertEqual(r[echo]["rtt"] >= 0,1);
+    assertEqual(string(r[echo]["banner"]),"ping\r\n");
+
+    #connected but nothing was said in time
+    assertEqual(r[silent]["status"],"open");
+    assertEqual(r[silent]["rtt"] >= 0,1);
+    assertEqual(len(r[silent]["banner"]),0);
+
+    #the SYN is dropped,the connect runs out of time
+    assertEqual(r[full]["status"],"timeout");
+    assertEqual(r[full]["rtt"],-1);
+    assertEqual(len(r[full]["banner"]),0);
+
+    assertEqual(r[closed]["status"],"closed");
+    assertEqual(r[closed]["rtt"],-1);
+}
+
+test_connect_many_loopback();
+
+func test_connect_many_sequential(){
+    #one connect in flight at a time gives the same answers
+    var targets = ["127.0.0.1:18702","127.0.0.1:1","127.0.0.1:18702"];
+    var r = TCPConnectMany(targets,1,2,"again");
+    assertEqual(r["127.0.0.1:18702"]["status"],"open");
+    assertEqual(string(r["127.0.0.1:18702"]["banner"]),"again");
+    assertEqual(r["127.0.0.1:1"]["status"],"closed");
+}
+
+test_connect_many_sequential();
+
+if(_is_test_passed){
+    Println("all test passed");
+}else{
+    Println("some test not passed");
+}
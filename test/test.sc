@@ -113,6 +113,48 @@ func test_bitwise_operation(){
 
 test_bitwise_operation();
 
+func test_compare(){
+    var one = 1,two = 2,half = 0.5,other = 0.5;
+    #the second pass runs the integer and float forms of the compare opcodes
+    for(var pass = 0; pass < 2; pass++){
+        assertEqual(one <= one,1);
+        assertEqual(one <= two,1);
+        assertEqual(two <= one,0);
+        assertEqual(half <= other,1);
+        assertEqual(one <= half,0);
+        assertEqual(one >= one,1);
+        assertEqual(one < one,0);
+        assertEqual(half >= other,1);
+    }
+    assertEqual(1 <= 1,1);
+    assertEqual(0.5 <= 0.5,1);
+    assertEqual(one <= 1.0,1);
+    assertEqual("a" <= "a",1);
+    var count = 0;
+    for(var i = 0; i <= 3; i++){
+        count++;
+    }
+    assertEqual(count,4);
+}
+
+test_compare();
+
+func test_modulo(){
+    var seven = 7,three = 3,count = 0;
+    assertEqual(seven % three,1);
+    assertEqual(three % seven,3);
+    assertEqual(6 % 4,2);
+    assertEqual((0 - seven) % three,0 - 1);
+    for(var i = 0; i < 10; i++){
+        if(i % 5 == 2){
+            count++;
+        }
+    }
+    assertEqual(count,2);
+}
+
+test_modulo();
+
 
 func test_loop(){
     var j =0,k=0;
@@ -235,6 +277,15 @@ func test_array_map(){
     assertEqual(dic["800"],"800");
     assertEqual(dic["accept-encoding"],"gzip, deflate, br");
 
+    #packed integer arrays switch to generic storage on the first other value
+    var ports = [80,443];
+    assertEqual(string([0x68,0x69]),"hi");
+    ports[1] = "https";
+    ports = append(ports,8080);
+    assertEqual(ports[0],80);
+    assertEqual(ports[1],"https");
+    assertEqual(ports[2],8080);
+
     var dic2 ={100:"100",200:"200",300:"300",400:"400",3.14:3.1415926};
     assertEqual(dic2[100],"100");
     assertEqual(dic2[3.14],3.1415926);
@@ -249,6 +300,29 @@ func map_test_ex(){
     dic2[3.1415926]= "pi";
     Println(dic2);
     Println(dic);
+
+    #keys keep their type and are iterated in insertion order
+    var ordered = {};
+    ordered["z"] = 1;
+    ordered[7] = 2;
+    ordered["a"] = 3;
+    var keys = [];
+    for k,v in ordered{
+        keys = append(keys,k);
+    }
+    assertEqual(keys[0],"z");
+    assertEqual(typeof(keys[1]),"integer");
+    assertEqual(keys[2],"a");
+
+    #reading a missing key doesn't insert it
+    assertEqual(ordered["missing"],nil);
+    assertEqual(len(ordered),3);
+    assertEqual(HasKey(ordered,7),true);
+    assertEqual(HasKey(ordered,"missing"),false);
+    assertEqual(Delete(ordered,7),true);
+    assertEqual(Delete(ordered,7),false);
+    assertEqual(HasKey(ordered,7),false);
+    assertEqual(len(ordered),2);
 }
 map_test_ex();
 
@@ -372,6 +446,132 @@ func byteslib_test(){
 
 byteslib_test();
 
+func string_allocations(){
+    var stats = VMStats();
+    return stats["String Allocations"];
+}
+
+func pass_through(value){
+    return value;
+}
+
+func test_value_moves(){
+    var blob = RepeatBytes(bytes("0123456789abcdef"),65536);
+    assertEqual(len(blob),1048576);
+    var start = string_allocations();
+    var overhead = string_allocations() - start;
+    start = string_allocations();
+    var result = pass_through(blob);
+    #reading variables shares the payload,the call and the return move it
+    assertEqual(string_allocations() - start - overhead,0);
+    assertEqual(len(result),1048576);
+}
+
+test_value_moves();
+
+func test_string_sharing(){
+    var text = "shared text";
+    var copy = text;
+    copy += "!";
+    assertEqual(text,"shared text");
+    assertEqual(copy,"shared text!");
+    var blob = bytes("abc");
+    var other = blob;
+    var start = string_allocations();
+    var overhead = string_allocations() - start;
+    start = string_allocations();
+    other += 100;
+    #the write copies the shared payload once,a later write owns it already
+    assertEqual(string_allocations() - start - overhead,1);
+    start = string_allocations();
+    other += 101;
+    assertEqual(string_allocations() - start - overhead,0);
+    assertEqual(len(blob),3);
+    assertEqual(len(other),5);
+}
+
+test_string_sharing();
+
+func test_serializer(){
+    var m = {"a":[1,2,"x<y"],"b":{"c":nil}};
+    assertEqual(ToString(m),"{a:[1,2,x<y],b:{c:nil}}");
+    assertEqual(ToString([1,[2,3],{"k":bytes("AB")}]),"[1,[2,3],{k:4142}]");
+    assertEqual(JSONEncode(m),"{\"a\":[1,2,\"x\\u003cy\"],\"b\":{\"c\":null}}");
+    assertEqual(JSONEncode("a<b&c"),"\"a\\u003cb\\u0026c\"");
+    assertEqual(JSONEncode([1.5,-3]),"[1.5,-3]");
+    #numbers are written whole
+    assertEqual(JSONEncode([1234567890123456789]),"[1234567890123456789]");
+    assertEqual(JSONEncode(0-9223372036854775807-1),"-9223372036854775808");
+    assertEqual(ToString(1234567890123456789),"1234567890123456789");
+    assertEqual(JSONEncode(0.0000001),"9.9999999999999995e-08");
+    assertEqual(JSONEncode(3.0),"3.0");
+    assertEqual(JSONEncode(123456789012.25),"123456789012.25");
+    #and read back as the same values
+    var list = JSONDecode(JSONEncode([1234567890123456789,0.0000001,3.0]));
+    assertEqual(list[0],1234567890123456789);
+    assertEqual(typeof(list[1]),"float");
+    assertEqual(list[1],0.0000001);
+    assertEqual(typeof(list[2]),"float");
+    list = JSONDecode("[1.5e3,-2E-2]");
+    assertEqual(list[0],1500);
+    assertEqual(list[1],0-0.02);
+}
+
+test_serializer();
+
+func symbol_helper(a){
+    return a + 1;
+}
+
+func test_symbols(){
+    var f = symbol_helper;
+    assertEqual(f(1),2);
+    #a variable may shadow the function name
+    var symbol_helper = 10;
+    assertEqual(symbol_helper,10);
+    assertEqual(f(symbol_helper),11);
+}
+
+test_symbols();
+
+func test_json_decode(){
+    var m = JSONDecode("{\"a\":[true,false,null],\"b\":\"s\"}");
+    assertEqual(m["a"][0],1);
+    assertEqual(m["a"][1],0);
+    assertEqual(m["a"][2],nil);
+    assertEqual(m["b"],"s");
+    #a failed parse leaves nothing behind for the next one
+    assertEqual(JSONDecode("[1,"),nil);
+    var a = JSONDecode("[2]");
+    assertEqual(a[0],2);
+}
+
+test_json_decode();
+
+func test_tcp_connect_many(){
+    #nothing listens on port 1 of the loopback
+    var r = TCPConnectMany(["127.0.0.1:1","badtarget"],4,2,"probe");
+    assertEqual(r["127.0.0.1:1"]["status"],"closed");
+    assertEqual(r["127.0.0.1:1"]["rtt"],-1);
+    assertEqual(r["badtarget"]["status"],"error");
+    assertEqual(len(r["badtarget"]["banner"]),0);
+    assertEqual(TCPConnect("127.0.0.1",1,2,false),nil);
+    assertEqual(TCPIsTimeout(),0);
+}
+
+test_tcp_connect_many();
+
+func test_tls_session_stats(){
+    var stats = TLSSessionStats();
+    assertEqual(typeof(stats["handshakes"]),"integer");
+    assertEqual(typeof(stats["resumed"]),"integer");
+    #nothing here opened a TLS connection
+    assertEqual(stats["handshakes"],0);
+    assertEqual(stats["resumed"],0);
+}
+
+test_tls_session_stats();
+
 if(_is_test_passed){
     Println("all test passed");
 }else{
@@ -0,0 +1,20 @@
+#TLS session resumption against a local server,start one with:
+#openssl s_server -www -accept 4433 -cert cert.pem -key key.pem
+#then run Interpreter test/tls_resume.sc,every connection after the first should resume
+#(-tls1_2 or -tls1_3 on the server picks the version)
+
+var count = 4;
+var stream;
+for(var i = 0; i < count; i++){
+    stream = TCPConnect("127.0.0.1",4433,5,true);
+    if(stream == nil){
+        Println("connect failed");
+        break;
+    }
+    TCPWrite(stream,"GET / HTTP/1.0\r\n\r\n");
+    #the answer comes after the TLS 1.3 tickets,reading it takes them in
+    TCPRead(stream,65536);
+    #the last reference closes it with a close_notify
+    stream = nil;
+}
+Println(TLSSessionStats());
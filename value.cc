@@ -1,6 +1,9 @@
 #include "value.hpp"
 
-#include <sstream>
+#include <math.h>
+#include <string.h>
+
+#include <functional>
 namespace Interpreter {
 
 std::list<std::string> split(const std::string& text, char split_char) {
@@ -22,31 +25,10 @@ std::list<std::string> split(const std::string& text, char split_char) {
 }
 
 std::string HTMLEscape(const std::string& src) {
-    const char* hex = "0123456789abcdef";
-    std::stringstream o;
-    int start = 0;
-    for (size_t i = 0; i < src.size(); i++) {
-        int c = src[i];
-        if (c == '<' || c == '>' || c == '&') {
-            o << "\\u00";
-            o << hex[c >> 4];
-            o << hex[c & 0xF];
-            start = i + 1;
-        }
-        if (c == 0xE2 && i + 2 < src.size() && (int)src[i + 1] == 0x80 &&
-            (src[i + 2] & (src[i + 2] ^ 1)) == 0xA8) {
-            if (start < i) {
-                o << src.substr(start, i - start);
-            }
-            o << "\\u202";
-            o << hex[src[i + 2] & 0xF];
-            start = i + 3;
-        }
-    }
-    if (start < src.size()) {
-        o << src.substr(start);
-    }
-    return o.str();
+    std::string result;
+    ValueWriter writer(result);
+    writer.WriteHTMLEscaped(src);
+    return result;
 }
 
 std::string ToString(double val) {
@@ -55,234 +37,514 @@ std::string ToString(double val) {
     return buffer;
 }
 std::string ToString(int64_t val) {
-    char buffer[16] = {0};
-    snprintf(buffer, 16, "%lld", val);
+    //INT64_MIN and the NUL
+    char buffer[21] = {0};
+    snprintf(buffer, sizeof(buffer), "%lld", (long long)val);
     return buffer;
 }
 
 std::string HexEncode(const char* buf, int count) {
-    char buffer[6] = {0};
-    std::string result = "";
-    for (size_t i = 0; i < count; i++) {
-        snprintf(buffer, 6, "%02X", (unsigned char)buf[i]);
-        result += buffer;
-    }
+    std::string result;
+    ValueWriter writer(result);
+    writer.WriteHex(buf, count);
     return result;
 }
 
-std::string ArrayObject::ToJSONString() const {
-    std::stringstream o;
-    bool first = true;
-    o << "[";
-    auto iter = _array.begin();
-    while (iter != _array.end()) {
-        if (!first) {
-            o << ",";
+size_t ArrayObject::size() const {
+    switch (mStorage) {
+    case kPackedInteger:
+        return mIntegers.size();
+    case kPackedFloat:
+        return mFloats.size();
+    default:
+        return mValues.size();
+    }
+}
+
+Value ArrayObject::Get(size_t index) const {
+    switch (mStorage) {
+    case kPackedInteger:
+        return Value(mIntegers[index]);
+    case kPackedFloat:
+        return Value(mFloats[index]);
+    default:
+        return mValues[index];
+    }
+}
+
+void ArrayObject::Set(size_t index, const Value& val) {
+    if (mStorage == kPackedInteger && val.Type == ValueType::kInteger) {
+        mIntegers[index] = val.Integer;
+        return;
+    }
+    if (mStorage == kPackedFloat && val.Type == ValueType::kFloat) {
+        mFloats[index] = val.Float;
+        return;
+    }
+    Values()[index] = val;
+}
+
+bool ArrayObject::Accepts(const Value& val) {
+    if (mStorage == kGeneric) {
+        return false;
+    }
+    if (size() == 0) {
+        if (val.Type == ValueType::kInteger) {
+            mStorage = kPackedInteger;
+        } else if (val.Type == ValueType::kFloat) {
+            mStorage = kPackedFloat;
         }
-        o << (*iter).ToJSONString();
-        first = false;
-        iter++;
     }
-    o << "]";
-    return o.str();
+    return (mStorage == kPackedInteger && val.Type == ValueType::kInteger) ||
+           (mStorage == kPackedFloat && val.Type == ValueType::kFloat);
 }
 
-bool cmp_key::operator()(const Value& k1, const Value& k2) const {
-    return k1.MapKey() < k2.MapKey();
+void ArrayObject::Push(Value val) {
+    if (!Accepts(val)) {
+        Values().push_back(std::move(val));
+    } else if (mStorage == kPackedInteger) {
+        mIntegers.push_back(val.Integer);
+    } else {
+        mFloats.push_back(val.Float);
+    }
 }
-std::string MapObject::ToJSONString() const {
-    std::stringstream o;
+
+void ArrayObject::CopyFrom(const ArrayObject& array) {
+    mStorage = array.mStorage;
+    mIntegers = array.mIntegers;
+    mFloats = array.mFloats;
+    mValues = array.mValues;
+}
+
+bool ArrayObject::operator==(const ArrayObject& array) const {
+    if (size() != array.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < size(); i++) {
+        if (!(Get(i) == array.Get(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<Value>& ArrayObject::Values() {
+    if (mStorage == kPackedInteger) {
+        mValues.assign(mIntegers.begin(), mIntegers.end());
+        std::vector<Value::INTVAR>().swap(mIntegers);
+    } else if (mStorage == kPackedFloat) {
+        mValues.assign(mFloats.begin(), mFloats.end());
+        std::vector<double>().swap(mFloats);
+    }
+    mStorage = kGeneric;
+    return mValues;
+}
+
+void ArrayObject::WriteJSON(ValueWriter& writer) const {
+    writer.Append('[');
+    for (size_t i = 0; i < size(); i++) {
+        if (i != 0) {
+            writer.Append(',');
+        }
+        writer.WriteJSON(Get(i));
+    }
+    writer.Append(']');
+}
+
+ValueMap::iterator ValueMap::find(const Value& key) {
+    int index = Lookup(key, key.KeyHash());
+    return index < 0 ? end() : iterator(this, index);
+}
+ValueMap::const_iterator ValueMap::find(const Value& key) const {
+    int index = Lookup(key, key.KeyHash());
+    return index < 0 ? end() : const_iterator(this, index);
+}
+
+Value& ValueMap::operator[](const Value& key) {
+    size_t hash = key.KeyHash();
+    int index = Lookup(key, hash);
+    if (index >= 0) {
+        return mEntries[index].second;
+    }
+    Entry entry = {key, Value(), hash, false};
+    mEntries.push_back(entry);
+    if (mEntries.size() > kLinearScanLimit) {
+        //removed entries still hold their buckets,so they count in the load
+        if (mEntries.size() * 4 > mIndex.size() * 3) {
+            Rehash(mIndex.size() ? mIndex.size() * 2 : kLinearScanLimit * 4);
+        } else {
+            size_t mask = mIndex.size() - 1;
+            size_t bucket = hash & mask;
+            while (mIndex[bucket] != kEmptyBucket) {
+                bucket = (bucket + 1) & mask;
+            }
+            mIndex[bucket] = mEntries.size() - 1;
+        }
+    }
+    return mEntries.back().second;
+}
+
+bool ValueMap::erase(const Value& key) {
+    size_t hash = key.KeyHash();
+    int index = Lookup(key, hash);
+    if (index < 0) {
+        return false;
+    }
+    if (mIndex.size()) {
+        size_t mask = mIndex.size() - 1;
+        size_t bucket = hash & mask;
+        while (mIndex[bucket] != index) {
+            bucket = (bucket + 1) & mask;
+        }
+        mIndex[bucket] = kRemovedBucket;
+    }
+    Entry& entry = mEntries[index];
+    entry.first = Value();
+    entry.second = Value();
+    entry.Removed = true;
+    mRemoved++;
+    Compact();
+    return true;
+}
+
+void ValueMap::Compact() {
+    if (mIterations > 0 || mRemoved <= kLinearScanLimit || mRemoved * 2 < mEntries.size()) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (!mEntries[i].Removed) {
+            if (count != i) {
+                mEntries[count] = std::move(mEntries[i]);
+            }
+            count++;
+        }
+    }
+    mEntries.resize(count);
+    mRemoved = 0;
+    if (mEntries.size() <= kLinearScanLimit) {
+        mIndex.clear();
+        return;
+    }
+    Rehash(mIndex.size() ? mIndex.size() : kLinearScanLimit * 4);
+}
+
+bool ValueMap::operator==(const ValueMap& right) const {
+    if (size() != right.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        const Entry& entry = mEntries[i];
+        if (entry.Removed) {
+            continue;
+        }
+        int index = right.Lookup(entry.first, entry.Hash);
+        if (index < 0 || !(entry.second == right.mEntries[index].second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int ValueMap::Lookup(const Value& key, size_t hash) const {
+    if (mIndex.size() == 0) {
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            const Entry& entry = mEntries[i];
+            if (!entry.Removed && entry.Hash == hash && entry.first.IsSameKey(key)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    size_t mask = mIndex.size() - 1;
+    size_t bucket = hash & mask;
+    while (mIndex[bucket] != kEmptyBucket) {
+        int index = mIndex[bucket];
+        if (index != kRemovedBucket && mEntries[index].Hash == hash &&
+            mEntries[index].first.IsSameKey(key)) {
+            return index;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    return -1;
+}
+
+void ValueMap::Rehash(size_t capacity) {
+    mIndex.assign(capacity, kEmptyBucket);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].Removed) {
+            continue;
+        }
+        size_t bucket = mEntries[i].Hash & mask;
+        while (mIndex[bucket] != kEmptyBucket) {
+            bucket = (bucket + 1) & mask;
+        }
+        mIndex[bucket] = i;
+    }
+}
+
+void MapObject::WriteJSON(ValueWriter& writer) const {
     bool first = true;
-    o << "{";
+    writer.Append('{');
     auto iter = _map.begin();
     while (iter != _map.end()) {
         //TODO check invalid json key
         if (!first) {
-            o << ",";
+            writer.Append(',');
         }
-        o << "\"";
-        o << iter->first.ToString();
-        o << "\"";
-        o << ":";
-        o << iter->second.ToJSONString();
+        writer.Append('"');
+        writer.Write(iter->first);
+        writer.Append("\":", 2);
+        writer.WriteJSON(iter->second);
         first = false;
         iter++;
     }
-    o << "}";
-    return o.str();
+    writer.Append('}');
 }
-std::string ArrayObject::ToString() const {
-    std::stringstream o;
-    bool first = true;
-    o << "[";
-    auto iter = _array.begin();
-    while (iter != _array.end()) {
-        if (!first) {
-            o << ",";
+void ArrayObject::Write(ValueWriter& writer) const {
+    writer.Append('[');
+    for (size_t i = 0; i < size(); i++) {
+        if (i != 0) {
+            writer.Append(',');
         }
-        o << (*iter).ToString();
-        first = false;
-        iter++;
+        writer.Write(Get(i));
     }
-    o << "]";
-    return o.str();
+    writer.Append(']');
 }
-std::string MapObject::ToString() const {
-    std::stringstream o;
+void MapObject::Write(ValueWriter& writer) const {
     bool first = true;
-    o << "{";
+    writer.Append('{');
     auto iter = _map.begin();
     while (iter != _map.end()) {
         if (!first) {
-            o << ",";
+            writer.Append(',');
         }
-        o << iter->first.MapKey();
-        o << ":";
-        o << iter->second.ToString();
+        if (iter->first.IsStringOrBytes()) {
+            writer.Append(iter->first.Bytes());
+        } else {
+            writer.Append(iter->first.MapKey());
+        }
+        writer.Append(':');
+        writer.Write(iter->second);
         first = false;
         iter++;
     }
-    o << "}";
-    return o.str();
-}
-
-Value::Value() : Type(ValueType::kNULL), Integer(0), bytes(), resource(NULL), object(NULL) {}
-
-Value::Value(bool val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(long val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(int val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(INTVAR val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(unsigned int val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(size_t val)
-        : Type(ValueType::kInteger), Integer(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(double val)
-        : Type(ValueType::kFloat), Float(val), bytes(), resource(NULL), object(NULL) {}
-Value::Value(const char* str)
-        : Type(ValueType::kString), Integer(0), bytes(str), resource(NULL), object(NULL) {}
-Value::Value(std::string val)
-        : Type(ValueType::kString), Integer(0), bytes(val), resource(NULL), object(NULL) {}
-
-Value::Value(const Instruction* f)
-        : Type(ValueType::kFunction), Function(f), bytes(), resource(NULL), object(NULL) {}
-Value::Value(RUNTIME_FUNCTION f)
-        : Type(ValueType::kRuntimeFunction),
-          RuntimeFunction(f),
-          bytes(),
-          resource(NULL),
-          object(NULL) {}
-
-Value::Value(const Value& val) {
+    writer.Append('}');
+}
+
+std::string Object::ToString() const {
+    std::string result;
+    ValueWriter writer(result);
+    Write(writer);
+    return result;
+}
+std::string Object::ToJSONString() const {
+    std::string result;
+    ValueWriter writer(result);
+    WriteJSON(writer);
+    return result;
+}
+
+void ValueWriter::Write(const Value& val) {
     switch (val.Type) {
+    case ValueType::kArray:
+    case ValueType::kMap:
+    case ValueType::kObject:
+        val.GetObject()->Write(*this);
+        break;
     case ValueType::kBytes:
+        WriteHex(val.Bytes().data(), val.Bytes().size());
+        break;
     case ValueType::kString:
-        Integer = 0;
-        bytes = val.bytes;
+        Append(val.Bytes());
         break;
-    case ValueType::kResource:
-        Integer = 0;
-        resource = val.resource;
+    case ValueType::kNULL:
+        Append("nil", 3);
         break;
     case ValueType::kInteger:
-        Integer = val.Integer;
-        break;
-    case ValueType::kArray:
-    case ValueType::kMap:
-    case ValueType::kObject:
-        object = val.object;
-        Integer = 0;
+        WriteInteger(val.Integer);
         break;
     case ValueType::kFloat:
-        Float = val.Float;
-        break;
-    case ValueType::kFunction:
-        Function = val.Function;
-        break;
-    case ValueType::kRuntimeFunction:
-        RuntimeFunction = val.RuntimeFunction;
+        WriteFloat(val.Float);
         break;
-    case ValueType::kNULL:
-        Integer = 0;
+    case ValueType::kResource:
+        Append("resource@", 9);
+        WriteInteger((int64_t)val.Heap);
         break;
     default:
-        throw RuntimeException("unknown value type!!!");
+        Append("unknown", 7);
+        break;
     }
-    Type = val.Type;
 }
-Value& Value::operator=(const Value& val) {
+
+void ValueWriter::WriteJSON(const Value& val) {
     switch (val.Type) {
-    case ValueType::kBytes:
-    case ValueType::kString:
-        Integer = 0;
-        bytes = val.bytes;
-        break;
-    case ValueType::kResource:
-        Integer = 0;
-        resource = val.resource;
-        break;
-    case ValueType::kInteger:
-        Integer = val.Integer;
-        break;
     case ValueType::kArray:
     case ValueType::kMap:
     case ValueType::kObject:
-        object = val.object;
-        Integer = 0;
+        val.GetObject()->WriteJSON(*this);
         break;
-    case ValueType::kFloat:
-        Float = val.Float;
-        break;
-    case ValueType::kFunction:
-        Function = val.Function;
+    case ValueType::kBytes:
+    case ValueType::kString:
+        Append('"');
+        WriteHTMLEscaped(val.Bytes());
+        Append('"');
         break;
-    case ValueType::kRuntimeFunction:
-        RuntimeFunction = val.RuntimeFunction;
+    case ValueType::kInteger:
+        WriteInteger(val.Integer);
         break;
-    case ValueType::kNULL:
-        Integer = 0;
+    case ValueType::kFloat:
+        //json has no nan or infinity
+        if (isfinite(val.Float)) {
+            WriteJSONFloat(val.Float);
+        } else {
+            Append("null", 4);
+        }
         break;
     default:
-        throw RuntimeException("unknown value type!!!");
+        Append("null", 4);
+        break;
+    }
+}
+
+//escape < > & and the line separators U+2028 U+2029 like html safe json encoders do
+void ValueWriter::WriteHTMLEscaped(const std::string& src) {
+    const char* hex = "0123456789abcdef";
+    const char* data = src.data();
+    size_t start = 0;
+    for (size_t i = 0; i < src.size(); i++) {
+        unsigned char c = data[i];
+        if (c == '<' || c == '>' || c == '&') {
+            Append(data + start, i - start);
+            char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            Append(escaped, 6);
+            start = i + 1;
+        }
+        if (c == 0xE2 && i + 2 < src.size() && (unsigned char)data[i + 1] == 0x80 &&
+            ((unsigned char)data[i + 2] & ~1) == 0xA8) {
+            Append(data + start, i - start);
+            char escaped[6] = {'\\', 'u', '2', '0', '2', hex[data[i + 2] & 0xF]};
+            Append(escaped, 6);
+            start = i + 3;
+            i += 2;
+        }
+    }
+    Append(data + start, src.size() - start);
+}
+
+void ValueWriter::WriteHex(const char* buf, size_t count) {
+    const char* hex = "0123456789ABCDEF";
+    for (size_t i = 0; i < count; i++) {
+        unsigned char c = buf[i];
+        char digits[2] = {hex[c >> 4], hex[c & 0xF]};
+        Append(digits, 2);
+    }
+}
+
+//same text as Interpreter::ToString
+void ValueWriter::WriteInteger(int64_t val) {
+    char buffer[21] = {0};
+    int count = snprintf(buffer, sizeof(buffer), "%lld", (long long)val);
+    Append(buffer, count);
+}
+//same 15 characters at most as Interpreter::ToString
+void ValueWriter::WriteFloat(double val) {
+    char buffer[16] = {0};
+    int count = snprintf(buffer, 16, "%f", val);
+    Append(buffer, count < 16 ? count : 15);
+}
+//17 significant digits read back as the same double,a fraction or an exponent is kept
+//so it's decoded as a float again
+void ValueWriter::WriteJSONFloat(double val) {
+    char buffer[32] = {0};
+    int count = snprintf(buffer, sizeof(buffer), "%.17g", val);
+    Append(buffer, count);
+    if (strpbrk(buffer, ".e") == NULL) {
+        Append(".0", 2);
+    }
+}
+
+void ValueWriter::Flush() {
+    if (mFile == NULL || mBuffer->empty()) {
+        return;
+    }
+    fwrite(mBuffer->data(), 1, mBuffer->size(), mFile);
+    mBuffer->clear();
+}
+
+const std::string Value::sEmptyBytes;
+int64_t StringObject::sAllocations = 0;
+
+Value::Value(const char* str) : Type(ValueType::kString), Heap(NULL) {
+    if (*str != 0) {
+        Heap = new StringObject(str);
+        Heap->AddRef();
+    }
+}
+Value::Value(std::string val) : Type(ValueType::kString), Heap(NULL) {
+    if (val.size() > 0) {
+        Heap = new StringObject(std::move(val));
+        Heap->AddRef();
     }
-    Type = val.Type;
-    return *this;
 }
 
-Value::Value(Resource* res)
-        : Type(ValueType::kResource), Integer(0), bytes(), resource(res), object(NULL) {}
-Value::Value(const std::vector<Value>& val) : Integer(0), bytes(), resource(NULL) {
-    Type = ValueType::kArray;
-    scoped_refptr<ArrayObject> ptr = new ArrayObject();
-    ptr->_array = val;
-    object = ptr.get();
+//string payloads are shared between copies,a writer gets its own payload first
+std::string& Value::MutableBytes() {
+    if (!IsStringOrBytes()) {
+        throw RuntimeException("value is not string or bytes");
+    }
+    if (Heap == NULL) {
+        Heap = new StringObject("");
+        Heap->AddRef();
+    } else if (!Heap->HasOneRef()) {
+        HeapObject* shared = Heap;
+        Heap = new StringObject(((StringObject*)shared)->Data);
+        Heap->AddRef();
+        shared->Release();
+    }
+    ((StringObject*)Heap)->Hash = 0;
+    return ((StringObject*)Heap)->Data;
+}
+
+Value::Value(Resource* res) : Type(ValueType::kResource), Heap(res) {
+    if (Heap != NULL) {
+        Heap->AddRef();
+    }
+}
+Value::Value(const std::vector<Value>& val) : Type(ValueType::kArray), Heap(NULL) {
+    ArrayObject* ptr = new ArrayObject();
+    for (size_t i = 0; i < val.size(); i++) {
+        ptr->Push(val[i]);
+    }
+    Heap = ptr;
+    Heap->AddRef();
 }
 
 Value Value::make_array() {
     Value ret = Value();
+    ret.Heap = new ArrayObject();
+    ret.Heap->AddRef();
     ret.Type = ValueType::kArray;
-    ret.object = new ArrayObject();
     return ret;
 }
 Value Value::make_bytes(std::string val) {
-    Value ret = Value(val);
+    Value ret(std::move(val));
     ret.Type = ValueType::kBytes;
     return ret;
 }
 Value Value::make_map() {
     Value ret = Value();
+    ret.Heap = new MapObject();
+    ret.Heap->AddRef();
     ret.Type = ValueType::kMap;
-    ret.object = new MapObject();
     return ret;
 }
 
 Value& Value::operator+=(const Value& right) {
     if (IsSameType(right)) {
         if (Type == ValueType::kString || Type == ValueType::kBytes) {
-            bytes += right.bytes;
+            MutableBytes() += right.Bytes();
             return *this;
         }
     }
@@ -297,11 +559,11 @@ Value& Value::operator+=(const Value& right) {
     if (Type == ValueType::kString) {
         switch (right.Type) {
         case ValueType::kString:
-            this->bytes += right.bytes;
+            MutableBytes() += right.Bytes();
             return *this;
         case ValueType::kFloat:
         case ValueType::kInteger:
-            this->bytes += right.ToString();
+            MutableBytes() += right.ToString();
             return *this;
         default:
             throw RuntimeException("+= operation not avaliable for right value ");
@@ -310,11 +572,11 @@ Value& Value::operator+=(const Value& right) {
     if (Type == ValueType::kBytes) {
         switch (right.Type) {
         case ValueType::kBytes:
-            this->bytes += right.bytes;
+            MutableBytes() += right.Bytes();
             return *this;
         case ValueType::kFloat:
         case ValueType::kInteger:
-            this->bytes += (unsigned char)right.ToInteger();
+            MutableBytes() += (unsigned char)right.ToInteger();
             return *this;
         default:
             throw RuntimeException("+= operation not avaliable for right value ");
@@ -324,40 +586,19 @@ Value& Value::operator+=(const Value& right) {
 }
 
 std::string Value::ToString() const {
-    switch (Type) {
-    case ValueType::kArray:
-    case ValueType::kMap:
-    case ValueType::kObject:
-        return object->ToString();
-    case ValueType::kBytes:
-        return HexEncode(bytes.c_str(), bytes.size());
-    case ValueType::kString:
-        return bytes;
-    case ValueType::kNULL:
-        return "nil";
-    case ValueType::kInteger:
-        return Interpreter::ToString(Integer);
-    case ValueType::kFloat:
-        return Interpreter::ToString(Float);
-    case ValueType::kResource:
-        return "resource@" + Interpreter::ToString((int64_t)resource.get());
-
-    default:
-        return "unknown";
+    if (Type == ValueType::kString) {
+        return Bytes();
     }
+    std::string result;
+    ValueWriter writer(result);
+    writer.Write(*this);
+    return result;
 }
 std::string Value::ToJSONString() const {
-    switch (Type) {
-    case ValueType::kArray:
-    case ValueType::kMap:
-    case ValueType::kObject:
-        return object->ToJSONString();
-    case ValueType::kBytes:
-    case ValueType::kString:
-        return "\"" + HTMLEscape(bytes) + "\"";
-    default:
-        return "null";
-    }
+    std::string result;
+    ValueWriter writer(result);
+    writer.WriteJSON(*this);
+    return result;
 }
 
 double Value::ToFloat() const {
@@ -381,12 +622,12 @@ Value::INTVAR Value::ToInteger() const {
 
 std::string Value::MapKey() const {
     if (IsObject()) {
-        return object->MapKey();
+        return GetObject()->MapKey();
     }
     switch (Type) {
     case ValueType::kBytes:
     case ValueType::kString:
-        return bytes;
+        return Bytes();
     case ValueType::kNULL:
         return "nil@nil";
     case ValueType::kInteger:
@@ -394,17 +635,80 @@ std::string Value::MapKey() const {
     case ValueType::kFloat:
         return "float@" + Interpreter::ToString(Float);
     case ValueType::kResource:
-        return "resource@" + Interpreter::ToString((int64_t)resource.get());
+        return "resource@" + Interpreter::ToString((int64_t)Heap);
     default:
         return "unknown";
     }
 }
+//spread the bits of integer keys,the table masks the low bits of a hash
+static size_t MixHash(uint64_t val) {
+    val ^= val >> 33;
+    val *= 0xff51afd7ed558ccdULL;
+    val ^= val >> 33;
+    return (size_t)val;
+}
+
+//never 0,a string payload uses 0 for a hash not computed yet
+static size_t StringHash(const std::string& str) {
+    size_t hash = std::hash<std::string>()(str);
+    return hash == 0 ? 1 : hash;
+}
+
+size_t Value::KeyHash() const {
+    switch (Type) {
+    case ValueType::kBytes:
+    case ValueType::kString: {
+        if (Heap == NULL) {
+            return StringHash(sEmptyBytes);
+        }
+        //a payload of a shared script const can be hashed by several executors at
+        //once,they all store the same value
+        StringObject* str = (StringObject*)Heap;
+        size_t hash = __atomic_load_n(&str->Hash, __ATOMIC_RELAXED);
+        if (hash == 0) {
+            hash = StringHash(str->Data);
+            __atomic_store_n(&str->Hash, hash, __ATOMIC_RELAXED);
+        }
+        return hash;
+    }
+    case ValueType::kInteger:
+        return MixHash((uint64_t)Integer);
+    case ValueType::kFloat: {
+        //0.0 and -0.0 are the same key
+        double val = Float == 0 ? 0 : Float;
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        return MixHash(bits);
+    }
+    default:
+        //nil,objects,resources and functions are hashed by their word
+        return MixHash((uint64_t)Integer) + Type;
+    }
+}
+
+bool Value::IsSameKey(const Value& right) const {
+    if (IsStringOrBytes() && right.IsStringOrBytes()) {
+        return Bytes() == right.Bytes();
+    }
+    if (Type != right.Type) {
+        return false;
+    }
+    switch (Type) {
+    case ValueType::kNULL:
+        return true;
+    case ValueType::kFloat:
+        return Float == right.Float;
+    default:
+        return Integer == right.Integer;
+    }
+}
+
 size_t Value::Length() {
     if (IsStringOrBytes()) {
-        return bytes.size();
+        return Bytes().size();
     }
     if (Type == ValueType::kArray) {
-        return _array().size();
+        return Array()->size();
     }
     if (Type == ValueType::kMap) {
         return _map().size();
@@ -424,27 +728,30 @@ bool Value::ToBoolean() {
     return true;
 }
 
-Value Value::operator[](const Value& key) {
+Value Value::operator[](const Value& key) const {
     if (IsStringOrBytes()) {
         if (!key.IsInteger()) {
             throw Interpreter::RuntimeException("the index key type must a Integer");
         }
-        if (key.Integer < 0 || key.Integer >= bytes.size()) {
+        if (key.Integer < 0 || key.Integer >= Bytes().size()) {
             throw Interpreter::RuntimeException("index of string(bytes) out of range");
         }
-        return Value((long)(bytes[key.Integer]) & 0xFF);
+        return Value((long)(Bytes()[key.Integer]) & 0xFF);
     }
     if (Type == ValueType::kArray) {
         if (!key.IsInteger()) {
             throw Interpreter::RuntimeException("the index key type must a Integer");
         }
-        if (key.Integer < 0 || key.Integer >= Length()) {
+        const ArrayObject* array = (ArrayObject*)Heap;
+        if (key.Integer < 0 || key.Integer >= array->size()) {
             throw Interpreter::RuntimeException("index of array out of range");
         }
-        return Array()->_array[key.Integer];
+        return array->Get(key.Integer);
     }
     if (Type == ValueType::kMap) {
-        return Map()->_map[key.MapKey()];
+        const MAPTYPE& map = ((MapObject*)Heap)->_map;
+        MAPTYPE::const_iterator iter = map.find(key);
+        return iter == map.end() ? Value() : iter->second;
     }
     throw Interpreter::RuntimeException("value not support index operation");
 }
@@ -473,18 +780,17 @@ Value Value::Slice(const Value& f, const Value& t) {
     }
 
     if (Type == ValueType::kString) {
-        std::string sub = bytes.substr(from, to - from);
+        std::string sub = Bytes().substr(from, to - from);
         return Value(sub);
     }
     if (Type == ValueType::kBytes) {
-        std::string sub = bytes.substr(from, to - from);
+        std::string sub = Bytes().substr(from, to - from);
         return make_bytes(sub);
     }
     Value ret = make_array();
-    std::vector<Value> result;
-    std::vector<Value>& array = _array();
+    ArrayObject* array = Array();
     for (size_t i = from; i < to; i++) {
-        ret.Array()->_array.push_back(array[i]);
+        ret.Array()->Push(array->Get(i));
     }
     return ret;
 }
@@ -497,10 +803,10 @@ void Value::SetValue(const Value& key, const Value& val) {
         if (!key.IsInteger()) {
             throw Interpreter::RuntimeException("the index key type must a Integer");
         }
-        if (key.Integer < 0 || key.Integer >= bytes.size()) {
+        if (key.Integer < 0 || key.Integer >= Bytes().size()) {
             throw Interpreter::RuntimeException("index of string(bytes) out of range");
         }
-        bytes[key.Integer] = val.ToInteger() & 0xFF;
+        MutableBytes()[key.Integer] = val.ToInteger() & 0xFF;
         return;
     }
     if (Type == ValueType::kArray) {
@@ -510,11 +816,11 @@ void Value::SetValue(const Value& key, const Value& val) {
         if (key.Integer < 0 || key.Integer >= Length()) {
             throw Interpreter::RuntimeException("index of array out of range");
         }
-        Array()->_array[key.Integer] = val;
+        Array()->Set(key.Integer, val);
         return;
     }
     if (Type == ValueType::kMap) {
-        Map()->_map[key.MapKey()] = val;
+        Map()->_map[key] = val;
         return;
     }
     throw RuntimeException("the value type not have value[index]= val operation");
@@ -523,7 +829,7 @@ void Value::SetValue(const Value& key, const Value& val) {
 Value operator+(const Value& left, const Value& right) {
     if (left.IsSameType(right) &&
         (ValueType::kString == left.Type || ValueType::kBytes == left.Type)) {
-        Value ret = Value::make_bytes(left.bytes + right.bytes);
+        Value ret = Value::make_bytes(left.Bytes() + right.Bytes());
         ret.Type = left.Type;
         return ret;
     }
@@ -568,12 +874,15 @@ Value operator%(const Value& left, const Value& right) {
     if (!left.IsInteger() || !right.IsInteger()) {
         throw Interpreter::RuntimeException("% operation not avaliable for this value ");
     }
-    return Value(left.ToInteger() & right.ToInteger());
+    if (right.ToInteger() == 0) {
+        throw Interpreter::RuntimeException("% by zero");
+    }
+    return Value(left.ToInteger() % right.ToInteger());
 }
 
 bool operator<(const Value& left, const Value& right) {
     if (left.Type == ValueType::kString && right.Type == ValueType::kString) {
-        return left.bytes < right.bytes;
+        return left.Bytes() < right.Bytes();
     }
     if (!left.IsNumber() || !right.IsNumber()) {
         throw Interpreter::RuntimeException("< operation not avaliable for this value ");
@@ -582,16 +891,16 @@ bool operator<(const Value& left, const Value& right) {
 }
 bool operator<=(const Value& left, const Value& right) {
     if (left.Type == ValueType::kString && right.Type == ValueType::kString) {
-        return left.bytes <= right.bytes;
+        return left.Bytes() <= right.Bytes();
     }
     if (!left.IsNumber() || !right.IsNumber()) {
         throw Interpreter::RuntimeException("<= operation not avaliable for this value ");
     }
-    return left.ToFloat() < right.ToFloat();
+    return left.ToFloat() <= right.ToFloat();
 }
 bool operator>(const Value& left, const Value& right) {
     if (left.Type == ValueType::kString && right.Type == ValueType::kString) {
-        return left.bytes > right.bytes;
+        return left.Bytes() > right.Bytes();
     }
     if (!left.IsNumber() || !right.IsNumber()) {
         throw Interpreter::RuntimeException("> operation not avaliable for this value ");
@@ -600,7 +909,7 @@ bool operator>(const Value& left, const Value& right) {
 }
 bool operator>=(const Value& left, const Value& right) {
     if (left.Type == ValueType::kString && right.Type == ValueType::kString) {
-        return left.bytes >= right.bytes;
+        return left.Bytes() >= right.Bytes();
     }
     if (!left.IsNumber() || !right.IsNumber()) {
         throw Interpreter::RuntimeException(">= operation not avaliable for this value ");
@@ -613,7 +922,7 @@ bool operator==(const Value& left, const Value& right) {
         return left.ToFloat() == right.ToFloat();
     }
     if (left.IsStringOrBytes() && right.IsStringOrBytes()) {
-        return left.bytes == right.bytes;
+        return left.Bytes() == right.Bytes();
     }
     //if (left.IsStringOrBytes() || right.IsStringOrBytes()) {
     //    if (left.IsInteger() || right.IsInteger()) {
@@ -627,15 +936,15 @@ bool operator==(const Value& left, const Value& right) {
     case ValueType::kNULL:
         return true;
     case ValueType::kResource:
-        return left.resource.get() == right.resource.get();
+        return left.Heap == right.Heap;
     case ValueType::kArray: {
-        ArrayObject* ptr = (ArrayObject*)left.object.get();
-        ArrayObject* src = (ArrayObject*)right.object.get();
-        return ptr->_array == src->_array;
+        ArrayObject* ptr = (ArrayObject*)left.Heap;
+        ArrayObject* src = (ArrayObject*)right.Heap;
+        return *ptr == *src;
     }
     case ValueType::kMap: {
-        MapObject* ptr = (MapObject*)left.object.get();
-        MapObject* src = (MapObject*)right.object.get();
+        MapObject* ptr = (MapObject*)left.Heap;
+        MapObject* src = (MapObject*)right.Heap;
         return ptr->_map == src->_map;
     }
 
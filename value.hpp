@@ -6,6 +6,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base.hpp"
@@ -20,7 +21,29 @@ std::string ToString(double val);
 std::string ToString(int64_t val);
 std::string HexEncode(const char* buf, int count);
 
-class Resource : public CRefCountedThreadSafe<Resource> {
+//every payload a Value keeps on the heap shares this refcount
+class HeapObject : public CRefCountedThreadSafe<HeapObject> {
+public:
+    virtual ~HeapObject() {}
+};
+
+class StringObject : public HeapObject {
+public:
+    std::string Data;
+    //hash of Data for map lookups,0 until it's computed
+    mutable size_t Hash;
+    //payloads created since start,VMStats() reports it to scripts
+    static int64_t sAllocations;
+
+public:
+    explicit StringObject(const std::string& data) : Data(data), Hash(0) { Allocated(); }
+    explicit StringObject(std::string&& data) : Data(std::move(data)), Hash(0) { Allocated(); }
+
+private:
+    static void Allocated() { __sync_add_and_fetch(&sAllocations, 1); }
+};
+
+class Resource : public HeapObject {
 public:
     virtual ~Resource() { Close(); }
     virtual void Close() {};
@@ -87,53 +110,33 @@ inline std::string ToString(int Type) {
 }; // namespace ValueType
 
 class Value;
+class ValueWriter;
 
-class Object : public CRefCountedThreadSafe<Object> {
+class Object : public HeapObject {
 public:
     virtual ~Object() {}
     virtual std::string ObjectType() const = 0;
     virtual std::string MapKey() const { return Interpreter::ToString((int64_t)this); }
-    virtual std::string ToString() const = 0;
-    virtual std::string ToJSONString() const = 0;
-};
-
-class ArrayObject : public Object {
-public:
-    std::vector<Value> _array;
-
-public:
-    std::string ObjectType() const { return "array"; };
-    std::string ToString() const;
-    std::string ToJSONString() const;
-};
-
-struct cmp_key {
-    bool operator()(const Value& k1, const Value& k2) const;
-};
-typedef std::map<Value, Value, cmp_key> MAPTYPE;
-class MapObject : public Object {
-public:
-    MAPTYPE _map;
-
-public:
-    std::string ObjectType() const { return "map"; };
+    //append the object to the buffer of the writer,nested values append to the same buffer
+    virtual void Write(ValueWriter& writer) const = 0;
+    virtual void WriteJSON(ValueWriter& writer) const = 0;
     std::string ToString() const;
     std::string ToJSONString() const;
 };
 
-inline bool IsMap(Object* obj) {
-    return obj->ObjectType() == "map";
-}
-inline bool IsArray(Object* obj) {
-    return obj->ObjectType() == "array";
-}
+class ArrayObject;
+class MapObject;
+class ValueMap;
+typedef ValueMap MAPTYPE;
 
 typedef scoped_refptr<Object> OBJECTPTR;
 typedef scoped_refptr<Resource> RESOURCE;
 class VMContext; 
 class Executor;
 typedef Value (*RUNTIME_FUNCTION)(std::vector<Value>& values, VMContext* ctx, Executor* vm);
-class Instruction;
+class ByteCode;
+//a Value is a type tag and one word,strings,resources and objects are kept behind
+//a refcounted heap pointer so copying a value never allocates
 class Value {
 public:
     typedef int64_t INTVAR;
@@ -141,30 +144,67 @@ public:
     union {
         INTVAR Integer;
         double Float;
-        const Instruction * Function;
+        const ByteCode * Function;
         RUNTIME_FUNCTION    RuntimeFunction;
+        //kString,kBytes (NULL for empty),kResource,kArray,kMap,kObject
+        HeapObject* Heap;
     };
-    std::string bytes;
-    RESOURCE resource;
-    OBJECTPTR object;
 
 public:
-    Value();
-    Value(bool val);
-    Value(long val);
-    Value(INTVAR val);
-    Value(int val);
-    Value(unsigned int val);
-    Value(size_t val);
-    Value(double val);
+    Value() : Type(ValueType::kNULL), Integer(0) {}
+    Value(bool val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(long val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(INTVAR val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(int val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(unsigned int val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(size_t val) : Type(ValueType::kInteger), Integer(val) {}
+    Value(double val) : Type(ValueType::kFloat), Float(val) {}
     Value(std::string val);
     Value(const char* str);
-    Value(const Value& val);
+    Value(const Value& val) : Type(val.Type), Integer(val.Integer) {
+        if (IsHeapType() && Heap != NULL) {
+            Heap->AddRef();
+        }
+    }
+    //the moved-from value is left nil
+    Value(Value&& val) noexcept : Type(val.Type), Integer(val.Integer) {
+        val.Type = ValueType::kNULL;
+        val.Integer = 0;
+    }
     Value(Resource*);
-    Value(const Instruction* );
-    Value(RUNTIME_FUNCTION func );
+    Value(const ByteCode* f) : Type(ValueType::kFunction), Function(f) {}
+    Value(RUNTIME_FUNCTION func) : Type(ValueType::kRuntimeFunction), RuntimeFunction(func) {}
     Value(const std::vector<Value>& val);
-    Value& operator=(const Value& right);
+    ~Value() {
+        if (IsHeapType() && Heap != NULL) {
+            Heap->Release();
+        }
+    }
+    Value& operator=(const Value& right) {
+        HeapObject* old = IsHeapType() ? Heap : NULL;
+        Type = right.Type;
+        Integer = right.Integer;
+        if (IsHeapType() && Heap != NULL) {
+            Heap->AddRef();
+        }
+        if (old != NULL) {
+            old->Release();
+        }
+        return *this;
+    }
+    Value& operator=(Value&& right) noexcept {
+        if (this != &right) {
+            HeapObject* old = IsHeapType() ? Heap : NULL;
+            Type = right.Type;
+            Integer = right.Integer;
+            right.Type = ValueType::kNULL;
+            right.Integer = 0;
+            if (old != NULL) {
+                old->Release();
+            }
+        }
+        return *this;
+    }
 
     static Value make_array();
     static Value make_bytes(std::string val);
@@ -175,6 +215,10 @@ public:
     bool IsNumber() const { return Type == ValueType::kInteger || Type == ValueType::kFloat; }
     bool IsStringOrBytes() const { return Type == ValueType::kString || Type == ValueType::kBytes; }
     bool IsSameType(const Value& right) const { return Type == right.Type; }
+    bool IsHeapType() const {
+        return (Type >= ValueType::kString && Type <= ValueType::kObject) ||
+               Type == ValueType::kResource;
+    }
     bool IsObject() const {
         return Type == ValueType::kObject || Type == ValueType::kArray || Type == ValueType::kMap;
     }
@@ -266,23 +310,265 @@ public:
         return Value(~Integer);
     }
 
-    ArrayObject* Array() { return (ArrayObject*)object.get(); }
-    MapObject* Map() { return (MapObject*)object.get(); }
-    MAPTYPE& _map() { return ((MapObject*)object.get())->_map; }
-    std::vector<Value>& _array() { return ((ArrayObject*)object.get())->_array; }
+    //the payload of kString/kBytes,empty for other types
+    const std::string& Bytes() const {
+        if (!IsStringOrBytes() || Heap == NULL) {
+            return sEmptyBytes;
+        }
+        return ((StringObject*)Heap)->Data;
+    }
+    //detaches a shared payload before it's written
+    std::string& MutableBytes();
+    Resource* GetResource() const { return Type == ValueType::kResource ? (Resource*)Heap : NULL; }
+    Object* GetObject() const { return IsObject() ? (Object*)Heap : NULL; }
+    ArrayObject* Array();
+    MapObject* Map();
+    MAPTYPE& _map();
+    std::vector<Value>& _array();
 
     std::string MapKey() const;
+    //hash and equality of map keys,strings and bytes with the same content are one key
+    size_t KeyHash() const;
+    bool IsSameKey(const Value& right) const;
     std::string ToString() const;
     std::string ToJSONString() const;
     double ToFloat() const;
     INTVAR ToInteger() const;
 
     size_t Length();
-    Value operator[](const Value& key);
+    //reading a missing key of a map gives nil without inserting it
+    Value operator[](const Value& key) const;
     std::string TypeName() const { return ValueType::ToString(Type); };
     bool ToBoolean();
     Value Slice(const Value& from, const Value& to);
     void SetValue(const Value& key, const Value& val);
+
+private:
+    static const std::string sEmptyBytes;
+};
+
+//arrays of only integers or only floats are kept packed,the first element of another
+//type unpacks them to Values for good
+class ArrayObject : public Object {
+public:
+    enum Storage {
+        kPackedInteger,
+        kPackedFloat,
+        kGeneric,
+    };
+
+public:
+    ArrayObject() : mStorage(kPackedInteger) {}
+    std::string ObjectType() const { return "array"; };
+    void Write(ValueWriter& writer) const;
+    void WriteJSON(ValueWriter& writer) const;
+
+    Storage GetStorage() const { return mStorage; }
+    size_t size() const;
+    Value Get(size_t index) const;
+    void Set(size_t index, const Value& val);
+    void Push(Value val);
+    void CopyFrom(const ArrayObject& array);
+    bool operator==(const ArrayObject& array) const;
+    //elements of a kPackedInteger array
+    const std::vector<Value::INTVAR>& Integers() const { return mIntegers; }
+    //switches to generic storage
+    std::vector<Value>& Values();
+
+private:
+    //an empty array takes the packed form of the first element pushed
+    bool Accepts(const Value& val);
+
+private:
+    Storage mStorage;
+    std::vector<Value::INTVAR> mIntegers;
+    std::vector<double> mFloats;
+    std::vector<Value> mValues;
+};
+
+//open addressing hash table of typed keys,entries are kept in insertion order
+//and iterated that way,small maps are scanned without building the index
+class ValueMap {
+public:
+    struct Entry {
+        Value first;
+        Value second;
+        size_t Hash;
+        bool Removed;
+    };
+
+    //iterators are positions in the entry list,they stay valid while the map grows
+    template <class Owner, class Item>
+    class Iterator {
+    public:
+        Iterator() : mMap(NULL), mIndex(0) {}
+        Iterator(Owner* map, size_t index) : mMap(map), mIndex(index) { SkipRemoved(); }
+        Item& operator*() const { return mMap->mEntries[mIndex]; }
+        Item* operator->() const { return &mMap->mEntries[mIndex]; }
+        Iterator& operator++() {
+            mIndex++;
+            SkipRemoved();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator ret = *this;
+            ++(*this);
+            return ret;
+        }
+        bool operator==(const Iterator& right) const {
+            return mMap == right.mMap && mIndex == right.mIndex;
+        }
+        bool operator!=(const Iterator& right) const { return !(*this == right); }
+        size_t Position() const { return mIndex; }
+
+    private:
+        void SkipRemoved() {
+            while (mIndex < mMap->mEntries.size() && mMap->mEntries[mIndex].Removed) {
+                mIndex++;
+            }
+        }
+        Owner* mMap;
+        size_t mIndex;
+    };
+    typedef Iterator<ValueMap, Entry> iterator;
+    typedef Iterator<const ValueMap, const Entry> const_iterator;
+
+    //removed entries are not compacted away while a lock is alive,
+    //so the positions a loop holds stay valid
+    class IterationLock {
+    public:
+        IterationLock() : mMap(NULL) {}
+        explicit IterationLock(ValueMap* map) : mMap(map) { Lock(); }
+        IterationLock(const IterationLock& lock) : mMap(lock.mMap) { Lock(); }
+        ~IterationLock() { Unlock(); }
+        IterationLock& operator=(const IterationLock& lock) {
+            if (this != &lock) {
+                Unlock();
+                mMap = lock.mMap;
+                Lock();
+            }
+            return *this;
+        }
+
+    private:
+        void Lock() {
+            if (mMap != NULL) {
+                mMap->mIterations++;
+            }
+        }
+        void Unlock() {
+            if (mMap != NULL && --mMap->mIterations == 0) {
+                mMap->Compact();
+            }
+        }
+        ValueMap* mMap;
+    };
+
+public:
+    ValueMap() : mRemoved(0), mIterations(0) {}
+    ValueMap(const ValueMap& map)
+            : mEntries(map.mEntries), mIndex(map.mIndex), mRemoved(map.mRemoved), mIterations(0) {}
+    ValueMap& operator=(const ValueMap& map) {
+        mEntries = map.mEntries;
+        mIndex = map.mIndex;
+        mRemoved = map.mRemoved;
+        Compact();
+        return *this;
+    }
+
+    size_t size() const { return mEntries.size() - mRemoved; }
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, mEntries.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, mEntries.size()); }
+    iterator find(const Value& key);
+    const_iterator find(const Value& key) const;
+    //inserts nil when the key not exist
+    Value& operator[](const Value& key);
+    //returns false when the key not exist
+    bool erase(const Value& key);
+    bool operator==(const ValueMap& right) const;
+
+private:
+    enum { kLinearScanLimit = 8 };
+    enum { kEmptyBucket = -1, kRemovedBucket = -2 };
+    int Lookup(const Value& key, size_t hash) const;
+    void Rehash(size_t capacity);
+    //drops the removed entries once they outnumber the others
+    void Compact();
+
+private:
+    std::vector<Entry> mEntries;
+    //entry index of every bucket,empty while the map is small
+    std::vector<int> mIndex;
+    size_t mRemoved;
+    int mIterations;
+};
+
+class MapObject : public Object {
+public:
+    MAPTYPE _map;
+
+public:
+    std::string ObjectType() const { return "map"; };
+    void Write(ValueWriter& writer) const;
+    void WriteJSON(ValueWriter& writer) const;
+};
+
+inline bool IsMap(Object* obj) {
+    return obj->ObjectType() == "map";
+}
+inline bool IsArray(Object* obj) {
+    return obj->ObjectType() == "array";
+}
+
+inline ArrayObject* Value::Array() {
+    return (ArrayObject*)Heap;
+}
+inline MapObject* Value::Map() {
+    return (MapObject*)Heap;
+}
+inline MAPTYPE& Value::_map() {
+    return ((MapObject*)Heap)->_map;
+}
+inline std::vector<Value>& Value::_array() {
+    return ((ArrayObject*)Heap)->Values();
+}
+
+//serializes values by appending to one growable buffer,nested arrays and maps never build
+//strings of their own.a writer on a FILE hands the buffer to the file every kFlushSize bytes
+class ValueWriter {
+public:
+    explicit ValueWriter(std::string& buffer) : mBuffer(&buffer), mFile(NULL) {}
+    explicit ValueWriter(FILE* file) : mBuffer(&mLocal), mFile(file) {}
+    ~ValueWriter() { Flush(); }
+
+    //same text as Value::ToString
+    void Write(const Value& val);
+    //same text as Value::ToJSONString
+    void WriteJSON(const Value& val);
+    void WriteHTMLEscaped(const std::string& src);
+    void WriteHex(const char* buf, size_t count);
+    void Append(const char* data, size_t size) {
+        mBuffer->append(data, size);
+        if (mFile != NULL && mBuffer->size() >= kFlushSize) {
+            Flush();
+        }
+    }
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+    void Append(char c) { Append(&c, 1); }
+    void Flush();
+
+private:
+    static const size_t kFlushSize = 64 * 1024;
+    void WriteInteger(int64_t val);
+    void WriteFloat(double val);
+    void WriteJSONFloat(double val);
+
+private:
+    std::string mLocal;
+    std::string* mBuffer;
+    FILE* mFile;
 };
 
 Value operator+(const Value& left, const Value& right);
@@ -1,5 +1,7 @@
 #include "vm.hpp"
 
+#include <algorithm>
+
 #include "logger.hpp"
 
 void RegisgerEngineBuiltinMethod(Interpreter::Executor* vm);
@@ -7,38 +9,80 @@ void RegisgerModulesBuiltinMethod(Interpreter::Executor* vm);
 
 namespace Interpreter {
 
-Executor::Executor(ExecutorCallback* callback) : mScriptList(), mCallback(callback) {
+Executor::Executor(ExecutorCallback* callback)
+        : mScriptList(), mCallback(callback), mOutput(stdout) {
     RegisgerEngineBuiltinMethod(this);
     RegisgerModulesBuiltinMethod(this);
 }
 
+Executor::~Executor() {
+    for (size_t i = 0; i < mByteCodes.size(); i++) {
+        delete mByteCodes[i];
+    }
+    mByteCodes.clear();
+    std::map<std::string, RESOURCE>::iterator iter = mModuleData.begin();
+    while (iter != mModuleData.end()) {
+        iter->second->Close();
+        iter++;
+    }
+    mModuleData.clear();
+}
+
+Resource* Executor::GetModuleData(const std::string& name) {
+    std::map<std::string, RESOURCE>::iterator iter = mModuleData.find(name);
+    if (iter == mModuleData.end()) {
+        return NULL;
+    }
+    return iter->second.get();
+}
+
+void Executor::SetModuleData(const std::string& name, Resource* data) {
+    mModuleData[name] = data;
+}
+
 bool Executor::Execute(scoped_refptr<Script> script, std::string& errmsg, bool showWarning) {
     bool bRet = false;
     mScriptList.push_back(script);
     scoped_refptr<VMContext> context = new VMContext(VMContext::File, NULL);
     context->SetEnableWarning(showWarning);
+    context->SetCallSiteGuard(&mCallSiteGuard);
+    mCallSiteGuard.Invalidate();
     try {
-        Execute(script->EntryPoint, context);
+        Run(Compile(script.get()), context);
         bRet = true;
     } catch (const RuntimeException& e) {
         errmsg = e.what();
     }
+    context = NULL;
     mScriptList.clear();
+    for (size_t i = 0; i < mByteCodes.size(); i++) {
+        delete mByteCodes[i];
+    }
+    mByteCodes.clear();
     return bRet;
 }
 
+const ByteCode* Executor::Compile(const Script* script) {
+    Compiler compiler(script, mByteCodes);
+    return compiler.CompileScript();
+}
+
 void Executor::RegisgerFunction(BuiltinMethod methods[], int count) {
     for (int i = 0; i < count; i++) {
-        mBuiltinMethods[methods[i].name] = methods[i].func;
+        Symbol name = SymbolTable::Intern(methods[i].name);
+        if (name >= mBuiltinMethods.size()) {
+            mBuiltinMethods.resize(name + 1, NULL);
+        }
+        mBuiltinMethods[name] = methods[i].func;
+        mCallSiteGuard.AddFunctionName(name, NULL);
     }
 }
 
-RUNTIME_FUNCTION Executor::GetBuiltinMethod(const std::string& name) {
-    std::map<std::string, RUNTIME_FUNCTION>::iterator iter = mBuiltinMethods.find(name);
-    if (iter == mBuiltinMethods.end()) {
+RUNTIME_FUNCTION Executor::GetBuiltinMethod(Symbol name) {
+    if (name >= mBuiltinMethods.size()) {
         return NULL;
     }
-    return iter->second;
+    return mBuiltinMethods[name];
 }
 
 void Executor::RequireScript(const std::string& name, VMContext* ctx) {
@@ -55,193 +99,79 @@ void Executor::RequireScript(const std::string& name, VMContext* ctx) {
         if (required.get() == NULL) {
             throw RuntimeException("load script <" + name + "> failed");
         }
-        scoped_refptr<Script> last = mScriptList.back();
-        required->RelocateInstruction(last->GetNextInstructionKey() + 100,
-                                      last->GetNextConstKey() + 100);
         mScriptList.push_back(required);
-        Execute(required->EntryPoint, ctx);
+        Run(Compile(required.get()), ctx);
     }
 }
 
 Value Executor::GetAvailableFunction(VMContext* ctx) {
-    std::vector<Value> builtin;
-    std::map<std::string, RUNTIME_FUNCTION>::iterator iter = mBuiltinMethods.begin();
-    while (iter != mBuiltinMethods.end()) {
-        builtin.push_back(Value(iter->first));
-        iter++;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < mBuiltinMethods.size(); i++) {
+        if (mBuiltinMethods[i] != NULL) {
+            names.push_back(SymbolTable::Name(i));
+        }
     }
+    std::sort(names.begin(), names.end());
+    std::vector<Value> builtin(names.begin(), names.end());
     Value result = Value::make_map();
     result._map()[Value("script")] = ctx->GetTotalFunction();
     result._map()[Value("builtin")] = builtin;
     return result;
 }
 
-const Instruction* Executor::GetInstruction(Instruction::keyType key) {
-    std::list<scoped_refptr<Script>>::iterator iter = mScriptList.begin();
-    while (iter != mScriptList.end()) {
-        if ((*iter)->IsContainInstruction(key)) {
-            return (*iter)->GetInstruction(key);
-        }
-        iter++;
+Value Executor::GetVarOrFunction(Symbol name, VMContext* ctx) {
+    Value ret;
+    if (ctx->GetVarValue(name, ret)) {
+        return ret;
     }
-    char buf[16] = {0};
-    snprintf(buf, 16, "%d", key);
-    throw RuntimeException(std::string("unknown instruction key:") + buf);
+    return GetFunction(name, ctx);
 }
 
-std::vector<const Instruction*> Executor::GetInstructions(std::vector<Instruction::keyType> keys) {
-    if (keys.size() == 0) {
-        return std::vector<const Instruction*>();
-    }
-    std::list<scoped_refptr<Script>>::iterator iter = mScriptList.begin();
-    while (iter != mScriptList.end()) {
-        if ((*iter)->IsContainInstruction(keys[0])) {
-            return (*iter)->GetInstructions(keys);
-        }
-        iter++;
+Value Executor::GetFunction(Symbol name, VMContext* ctx) {
+    const ByteCode* func = ctx->GetFunction(name);
+    if (func != NULL) {
+        return Value(func);
     }
-    char buf[16] = {0};
-    snprintf(buf, 16, "%d", keys[0]);
-    throw RuntimeException(std::string("unknown instruction key:") + buf);
-}
-
-Value Executor::GetConstValue(Instruction::keyType key) {
-    std::list<scoped_refptr<Script>>::iterator iter = mScriptList.begin();
-    while (iter != mScriptList.end()) {
-        if ((*iter)->IsContainConst(key)) {
-            return (*iter)->GetConstValue(key);
-        }
-        iter++;
+    RUNTIME_FUNCTION method = GetBuiltinMethod(name);
+    if (method == NULL) {
+        throw RuntimeException("variable not found :" + SymbolTable::Name(name));
     }
-    throw RuntimeException("unknown const key");
+    return Value(method);
 }
 
-Value Executor::Execute(const Instruction* ins, VMContext* ctx) {
-    //LOG("execute " + ins->ToString());
-    if (ctx->IsExecutedInterupt()) {
-        LOG("Instruction execute interupted :" + ins->ToString());
-        return ctx->GetReturnValue();
-    }
-    if (ins->OpCode >= Instructions::kADD && ins->OpCode <= Instructions::kMAXArithmeticOP) {
-        return ExecuteArithmeticOperation(ins, ctx);
-    }
-    if (ins->OpCode >= Instructions::kWrite && ins->OpCode <= Instructions::kRSHIFTWrite) {
-        return ExecuteUpdateVar(ins, ctx);
-    }
-    switch (ins->OpCode) {
-    case Instructions::kNop:
-        return Value();
-    case Instructions::kConst:
-        return GetConstValue(ins->Refs[0]);
-    case Instructions::kNewVar: {
-        ctx->AddVar(ins->Name);
-        if (ins->Refs.size()) {
-            Value initValue = Execute(GetInstruction(ins->Refs[0]), ctx);
-            ctx->SetVarValue(ins->Name, initValue);
-            return initValue;
-        }
-        return Value();
-    }
-    case Instructions::kReadVar:
-        return GetVarOrFunction(ins->Name, ctx);
-    case Instructions::kMinus: {
-        Value val = Execute(GetInstruction(ins->Refs.front()), ctx);
-        switch (val.Type) {
-        case ValueType::kInteger:
-            val.Integer = (-val.Integer);
-            return val;
-        case ValueType::kFloat:
-            val.Float = (-val.Float);
-            return val;
-        default:
-            throw RuntimeException("minus operation only can applay to integer or float");
-        }
-    }
-    case Instructions::kNewFunction: {
-        if (ins->Name.size()) {
-            ctx->AddFunction(ins);
-            return Value();
-        }
-        return Value(ins);
-    }
-    case Instructions::kCallFunction: {
-        return CallFunction(ins, ctx);
-    }
-
-    case Instructions::kGroup: {
-        ExecuteList(GetInstructions(ins->Refs), ctx);
-        return Value();
+void Executor::BindParameters(const ByteCode* func, Symbol name, Value* args, size_t count,
+                              VMContext* ctx) {
+    if (!func->HasParameters) {
+        return;
     }
-
-    case Instructions::kIFStatement: {
-        ExecuteIfStatement(ins, ctx);
-        return Value();
+    if (func->Parameters.size() != count) {
+        throw RuntimeException("actual parameters count not equal formal paramers for func:" +
+                               SymbolTable::Name(name));
     }
-
-    //return indcate the action executed or not
-    case Instructions::kContitionExpression: {
-        Value val = Execute(GetInstruction(ins->Refs[0]), ctx);
-        if (val.ToBoolean()) {
-            Execute(GetInstruction(ins->Refs[1]), ctx);
-        }
-        return val;
+    for (size_t i = 0; i < count; i++) {
+        ctx->AddVar((int)i);
+        *ctx->GetSlot(0, i) = std::move(args[i]);
     }
+}
 
-    case Instructions::kRETURNStatement: {
-        ctx->ReturnExecuted(Execute(GetInstruction(ins->Refs[0]), ctx));
-        return Value();
+Value Executor::CallScriptFunction(const std::string& name, std::vector<Value>& args,
+                                   VMContext* ctx) {
+    const ByteCode* func = ctx->GetFunction(SymbolTable::Intern(name));
+    if (func == NULL) {
+        throw RuntimeException("function not found :" + name);
     }
+    return CallScriptFunction(func, args, ctx);
+}
 
-    case Instructions::kFORStatement: {
-        scoped_refptr<VMContext> newCtx = new VMContext(VMContext::For, ctx);
-        ExecuteForStatement(ins, newCtx);
-        return Value();
-    }
-    case Instructions::kForInStatement: {
-        scoped_refptr<VMContext> newCtx = new VMContext(VMContext::For, ctx);
-        ExecuteForInStatement(ins, newCtx);
-        return Value();
-    }
-    case Instructions::kSwitchCaseStatement: {
-        scoped_refptr<VMContext> newCtx = new VMContext(VMContext::Switch, ctx);
-        ExecuteSwitchStatement(ins, newCtx);
-        return Value();
-    }
-    case Instructions::kBREAKStatement: {
-        ctx->BreakExecuted();
-        return Value();
-    }
-    case Instructions::kCONTINUEStatement: {
-        ctx->ContinueExecuted();
-        return Value();
-    }
-    case Instructions::kCreateMap:
-        return ExecuteCreateMap(ins, ctx);
-    case Instructions::kCreateArray:
-        return ExecuteCreateArray(ins, ctx);
-    case Instructions::kReadAt:
-        return ExecuteReadAt(ins, ctx);
-    case Instructions::kWriteAt:
-        return ExecuteWriteAt(ins, ctx);
-    case Instructions::kSlice:
-        return ExecuteSlice(ins, ctx);
-    default:
-        LOG("Unknown Instruction:" + ins->ToString());
-        return Value();
-    }
+Value Executor::CallScriptFunction(const ByteCode* func, std::vector<Value>& args,
+                                   VMContext* ctx) {
+    scoped_refptr<VMContext> newCtx = mContextPool.New(VMContext::Function, ctx, &func->Scopes[0]);
+    BindParameters(func, func->Name, args.size() ? &args[0] : NULL, args.size(), newCtx);
+    return Run(func, newCtx);
 }
 
-Value Executor::ExecuteUpdateVar(const Instruction* ins, VMContext* ctx) {
-    Value val;
-    if (ins->Refs.size()) {
-        val = Execute(GetInstruction(ins->Refs[0]), ctx);
-    }
-    if (ins->OpCode == Instructions::kWrite) {
-        ctx->SetVarValue(ins->Name, val);
-        return Value();
-    }
-    Value oldVal = ctx->GetVarValue(ins->Name);
-    switch (ins->OpCode) {
+void Executor::UpdateValue(Value& oldVal, const Value& val, Instructions::Type op) {
+    switch (op) {
     case Instructions::kADDWrite:
         oldVal += val;
         break;
@@ -269,430 +199,522 @@ Value Executor::ExecuteUpdateVar(const Instruction* ins, VMContext* ctx) {
     case Instructions::kRSHIFTWrite:
         oldVal >>= val;
         break;
-    case Instructions::kINCWrite:
-        if (oldVal.Type != ValueType::kInteger) {
-            throw RuntimeException("++ operation only can used on Integer ");
-        }
-        oldVal.Integer++;
-        break;
-    case Instructions::kDECWrite:
-        if (oldVal.Type != ValueType::kInteger) {
-            throw RuntimeException("-- operation only can used on Integer ");
-        }
-        oldVal.Integer--;
-        break;
     default:
-        LOG("Unknown Instruction:" + ins->ToString());
+        LOG("Unknown update operation");
     }
-    ctx->SetVarValue(ins->Name, oldVal);
-    return oldVal;
 }
 
-Value Executor::ExecuteIfStatement(const Instruction* ins, VMContext* ctx) {
-    const Instruction* one = GetInstruction(ins->Refs[0]);
-    const Instruction* tow = GetInstruction(ins->Refs[1]);
-    const Instruction* three = GetInstruction(ins->Refs[2]);
-    Value val = Execute(one, ctx);
-    if (val.ToBoolean()) {
-        return Value();
-    }
-    if (ctx->IsExecutedInterupt()) {
-        return Value();
-    }
-    if (tow->OpCode != Instructions::kNop) {
-        std::vector<const Instruction*> branchs = GetInstructions(tow->Refs);
-        std::vector<const Instruction*>::iterator iter = branchs.begin();
-        while (iter != branchs.end()) {
-            val = Execute(*iter, ctx);
-            if (val.ToBoolean()) {
-                break;
+//with GCC and clang the dispatch is threaded through a table of label addresses.
+//handlers leave through a plain goto so the destructors of their locals run,
+//a computed goto skips them; the compiler duplicates the jump into every handler
+#if defined(__GNUC__)
+#define VM_CASE(name) L_##name:
+#define VM_SWITCH() \
+    vm_dispatch:    \
+    goto* dispatch_table[*pc];
+#define VM_DISPATCH() goto vm_dispatch
+#else
+#define VM_CASE(name) case ByteCodes::k##name:
+#define VM_SWITCH() \
+    for (;;)        \
+        switch (*pc)
+#define VM_DISPATCH() continue
+#endif
+
+#define VM_VAR(index) (code->Vars[index])
+#define VM_SLOT(var) ((var).Slot < 0 ? NULL : ctx->GetSlot((var).Depth, (var).Slot))
+
+#define VM_NEXT(count)   \
+    {                    \
+        pc += count + 1; \
+        VM_DISPATCH();   \
+    }
+
+#define VM_BINARY(name, expr)                      \
+    VM_CASE(name) {                                \
+        Value& firstVal = stack[stack.size() - 2]; \
+        Value& secondVal = stack.back();           \
+        firstVal = expr;                           \
+        stack.pop_back();                          \
+        VM_NEXT(0);                                \
+    }
+
+//rewrite the running opcode,the next dispatch runs the new one
+#define VM_QUICKEN(op) (code->Code[pc - &code->Code[0]] = ByteCodes::k##op)
+
+//the generic form rewrites itself to the int-int or float-float form when it meets such
+//operands,a specialized form whose guard fails evaluates the generic way
+#define VM_QUICKENED_BINARY(name, expr, intExpr, floatExpr)                                    \
+    VM_CASE(name) {                                                                            \
+        Value& firstVal = stack[stack.size() - 2];                                             \
+        Value& secondVal = stack.back();                                                       \
+        if (firstVal.Type == ValueType::kInteger && secondVal.Type == ValueType::kInteger) {   \
+            VM_QUICKEN(name##_II);                                                             \
+            VM_DISPATCH();                                                                     \
+        }                                                                                      \
+        if (firstVal.Type == ValueType::kFloat && secondVal.Type == ValueType::kFloat) {       \
+            VM_QUICKEN(name##_FF);                                                             \
+            VM_DISPATCH();                                                                     \
+        }                                                                                      \
+        firstVal = expr;                                                                       \
+        stack.pop_back();                                                                      \
+        VM_NEXT(0);                                                                            \
+    }                                                                                          \
+    VM_CASE(name##_II) {                                                                       \
+        Value& firstVal = stack[stack.size() - 2];                                             \
+        Value& secondVal = stack.back();                                                       \
+        if (firstVal.Type == ValueType::kInteger && secondVal.Type == ValueType::kInteger) {   \
+            intExpr;                                                                           \
+        } else {                                                                               \
+            firstVal = expr;                                                                   \
+        }                                                                                      \
+        stack.pop_back();                                                                      \
+        VM_NEXT(0);                                                                            \
+    }                                                                                          \
+    VM_CASE(name##_FF) {                                                                       \
+        Value& firstVal = stack[stack.size() - 2];                                             \
+        Value& secondVal = stack.back();                                                       \
+        if (firstVal.Type == ValueType::kFloat && secondVal.Type == ValueType::kFloat) {       \
+            floatExpr;                                                                         \
+        } else {                                                                               \
+            firstVal = expr;                                                                   \
+        }                                                                                      \
+        stack.pop_back();                                                                      \
+        VM_NEXT(0);                                                                            \
+    }
+
+#define VM_ARITHMETIC(name, op)                                                  \
+    VM_QUICKENED_BINARY(name, firstVal op secondVal,                             \
+                        firstVal.Integer = firstVal.Integer op secondVal.Integer, \
+                        firstVal.Float = firstVal.Float op secondVal.Float)
+
+//numbers are compared as double like the generic operators do
+#define VM_COMPARE(name, op)                                                      \
+    VM_QUICKENED_BINARY(                                                          \
+            name, Value(firstVal op secondVal),                                   \
+            firstVal.Integer = (double)firstVal.Integer op (double)secondVal.Integer, \
+            {                                                                     \
+                bool ret = firstVal.Float op secondVal.Float;                     \
+                firstVal.Type = ValueType::kInteger;                              \
+                firstVal.Integer = ret;                                           \
+            })
+
+Value Executor::Run(const ByteCode* entry, VMContext* root) {
+#if defined(__GNUC__)
+    static const void* dispatch_table[] = {
+#define BYTECODE_LABEL(name, count) &&L_##name,
+            BYTECODE_LIST(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+    };
+#endif
+    const ByteCode* code = entry;
+    const int* pc = &code->Code[0];
+    VMContext* ctx = root;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<scoped_refptr<VMContext>> scopes;
+    std::vector<ForInState> iterators;
+    //arguments of builtin calls,reused so calls don't allocate once it's grown
+    std::vector<Value> args;
+
+    VM_SWITCH() {
+        VM_CASE(Nop) VM_NEXT(0);
+        VM_CASE(Const) {
+            stack.push_back(code->Constants[pc[1]]);
+            VM_NEXT(1);
+        }
+        VM_CASE(Nil) {
+            stack.push_back(Value());
+            VM_NEXT(0);
+        }
+        VM_CASE(Pop) {
+            stack.pop_back();
+            VM_NEXT(0);
+        }
+        VM_CASE(Pick) {
+            stack.push_back(stack[stack.size() - 1 - pc[1]]);
+            VM_NEXT(1);
+        }
+        VM_CASE(ReadVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            if (slot != NULL) {
+                stack.push_back(*slot);
+            } else {
+                stack.push_back(GetVarOrFunction(var.Name, ctx));
             }
-            if (ctx->IsExecutedInterupt()) {
-                return Value();
+            VM_NEXT(1);
+        }
+        VM_CASE(NewVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            if (var.Slot >= 0) {
+                ctx->AddVar(var.Slot);
+            } else {
+                ctx->AddVar(var.Name);
             }
-            iter++;
+            VM_NEXT(1);
         }
-    }
-    if (val.ToBoolean()) {
-        return Value();
-    }
-    if (three->OpCode == Instructions::kNop) {
-        return Value();
-    }
-    Execute(three, ctx);
-    return Value();
-}
-
-Value Executor::ExecuteArithmeticOperation(const Instruction* ins, VMContext* ctx) {
-    const Instruction* first = GetInstruction(ins->Refs[0]);
-    Value firstVal = Execute(first, ctx);
-    if (ins->OpCode == Instructions::kNOT) {
-        return Value(!firstVal.ToBoolean());
-    }
-    if (ins->OpCode == Instructions::kBNG) {
-        return ~firstVal;
-    }
-    const Instruction* second = GetInstruction(ins->Refs[1]);
-    Value secondVal = Execute(second, ctx);
-
-    switch (ins->OpCode) {
-    case Instructions::kADD:
-        return firstVal + secondVal;
-    case Instructions::kSUB:
-        return firstVal - secondVal;
-    case Instructions::kMUL:
-        return firstVal * secondVal;
-    case Instructions::kDIV:
-        return firstVal / secondVal;
-    case Instructions::kMOD:
-        return firstVal % secondVal;
-    case Instructions::kGT:
-        return Value(firstVal > secondVal);
-    case Instructions::kGE:
-        return Value(firstVal >= secondVal);
-    case Instructions::kLT:
-        return Value(firstVal < secondVal);
-    case Instructions::kLE:
-        return Value(firstVal <= secondVal);
-    case Instructions::kEQ:
-        return Value(firstVal == secondVal);
-    case Instructions::kNE:
-        return Value(firstVal != secondVal);
-    case Instructions::kBAND:
-        return firstVal & secondVal;
-    case Instructions::kBOR:
-        return firstVal | secondVal;
-    case Instructions::kBXOR:
-        return firstVal ^ secondVal;
-    case Instructions::kLSHIFT:
-        return firstVal << secondVal;
-    case Instructions::kRSHIFT:
-        return firstVal >> secondVal;
-    case Instructions::kOR:
-        return Value(firstVal.ToBoolean() || secondVal.ToBoolean());
-    case Instructions::kAND:
-        return Value(firstVal.ToBoolean() && secondVal.ToBoolean());
-    default:
-        LOG("Unknow OpCode:" + ins->ToString());
-        return Value();
-    }
-}
-
-Value Executor::ExecuteList(std::vector<const Instruction*> insList, VMContext* ctx) {
-    std::vector<const Instruction*>::iterator iter = insList.begin();
-    while (iter != insList.end()) {
-        Execute(*iter, ctx);
-        if (ctx->IsExecutedInterupt()) {
-            break;
+        VM_CASE(WriteVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            if (slot != NULL) {
+                *slot = std::move(stack.back());
+            } else {
+                ctx->SetVarValue(var.Name, std::move(stack.back()));
+            }
+            stack.pop_back();
+            VM_NEXT(1);
         }
-        iter++;
-    }
-    return Value();
-}
-
-Value Executor::GetVarOrFunction(const std::string& name, VMContext* ctx) {
-    Value ret;
-    if (ctx->GetVarValue(name, ret)) {
-        return ret;
-    }
-    const Instruction* func = ctx->GetFunction(name);
-    if (func != NULL) {
-        return Value(func);
-    }
-    RUNTIME_FUNCTION method = GetBuiltinMethod(name);
-    if (method == NULL) {
-        throw RuntimeException("variable not found :" + name);
-    }
-    return Value(method);
-}
-
-Value Executor::CallFunction(const Instruction* ins, VMContext* ctx) {
-    Value func = GetVarOrFunction(ins->Name, ctx);
-    if (func.Type == ValueType::kRuntimeFunction) {
-        return CallRutimeFunction(ins, ctx, func.RuntimeFunction);
-    } else if (func.Type == ValueType::kFunction) {
-        return CallScriptFunction(ins, ctx, func.Function);
-    } else {
-        throw RuntimeException("can't as function called :" + ins->Name);
-    }
-}
-
-Value Executor::CallRutimeFunction(const Instruction* ins, VMContext* ctx,
-                                   RUNTIME_FUNCTION method) {
-    std::vector<Value> actualValues;
-    if (ins->Refs.size() == 1) {
-        actualValues = InstructionToValue(GetInstructions(GetInstruction(ins->Refs[0])->Refs), ctx);
-    }
-    if (ctx->IsExecutedInterupt()) {
-        return ctx->GetReturnValue();
-    }
-    Value val = method(actualValues, ctx, this);
-    return val;
-}
-
-Value Executor::CallScriptFunction(const Instruction* ins, VMContext* ctx,
-                                   const Instruction* func) {
-    std::vector<Value> actualValues;
-    scoped_refptr<VMContext> newCtx = new VMContext(VMContext::Function, ctx);
-    if (ins->Refs.size() == 1) {
-        actualValues = InstructionToValue(GetInstructions(GetInstruction(ins->Refs[0])->Refs), ctx);
-    }
-    if (ctx->IsExecutedInterupt()) {
-        return ctx->GetReturnValue();
-    }
-    if (func->Refs.size() == 2) {
-        std::vector<const Instruction*> formalParamers =
-                GetInstructions(GetInstruction(func->Refs[1])->Refs);
-        if (formalParamers.size() != actualValues.size()) {
-            throw RuntimeException("actual parameters count not equal formal paramers for func:" +
-                                   ins->Name);
-        }
-        std::vector<const Instruction*>::iterator iter = formalParamers.begin();
-        int i = 0;
-        while (iter != formalParamers.end()) {
-            Execute(*iter, newCtx);
-            newCtx->SetVarValue((*iter)->Name, actualValues[i]);
-            i++;
-            iter++;
+        VM_CASE(UpdateVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            if (slot != NULL) {
+                UpdateValue(*slot, stack.back(), pc[2]);
+            } else {
+                Value oldVal = ctx->GetVarValue(var.Name);
+                UpdateValue(oldVal, stack.back(), pc[2]);
+                ctx->SetVarValue(var.Name, std::move(oldVal));
+            }
+            stack.pop_back();
+            VM_NEXT(2);
         }
-    }
-    Execute(GetInstruction(func->Refs[0]), newCtx);
-    Value val = newCtx->GetReturnValue();
-    return val;
-}
-Value Executor::CallScriptFunction(const std::string& name, std::vector<Value>& args,
-                                   VMContext* ctx) {
-    scoped_refptr<VMContext> newCtx = new VMContext(VMContext::Function, ctx);
-    const Instruction* func = ctx->GetFunction(name);
-    const Instruction* body = GetInstruction(func->Refs[0]);
-    if (func->Refs.size() == 2) {
-        const Instruction* formalParamersList = GetInstruction(func->Refs[0]);
-        if (args.size() != formalParamersList->Refs.size()) {
-            throw RuntimeException("actual parameters count not equal formal paramers");
-        }
-        std::vector<const Instruction*> formalParamers = GetInstructions(formalParamersList->Refs);
-        std::vector<const Instruction*>::iterator iter = formalParamers.begin();
-        int i = 0;
-        while (iter != formalParamers.end()) {
-            Execute(*iter, ctx);
-            newCtx->SetVarValue((*iter)->Name, args[i]);
-            i++;
-            iter++;
+        VM_CASE(IncVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            Value oldVal = slot ? *slot : ctx->GetVarValue(var.Name);
+            if (oldVal.Type != ValueType::kInteger) {
+                throw RuntimeException("++ operation only can used on Integer ");
+            }
+            if (slot != NULL) {
+                slot->Integer++;
+            } else {
+                oldVal.Integer++;
+                ctx->SetVarValue(var.Name, std::move(oldVal));
+            }
+            VM_NEXT(1);
         }
-    }
-    Execute(body, newCtx);
-    Value val = newCtx->GetReturnValue();
-    return val;
-}
-
-Value Executor::ExecuteForStatement(const Instruction* ins, VMContext* ctx) {
-    const Instruction* init = GetInstruction(ins->Refs[0]);
-    const Instruction* condition = GetInstruction(ins->Refs[1]);
-    const Instruction* after = GetInstruction(ins->Refs[2]);
-    const Instruction* block = GetInstruction(ins->Refs[3]);
-    Execute(init, ctx);
-    while (true) {
-        Value val = Value(1l);
-        if (!condition->IsNULL()) {
-            val = Execute(condition, ctx);
-        }
-        if (!val.ToBoolean()) {
-            break;
-        }
-        Execute(block, ctx);
-        ctx->CleanContinueFlag();
-        if (ctx->IsExecutedInterupt()) {
-            break;
-        }
-        Execute(after, ctx);
-    }
-    return Value();
-}
-
-Value Executor::ExecuteForInStatement(const Instruction* ins, VMContext* ctx) {
-    const Instruction* iter_able_obj = GetInstruction(ins->Refs[0]);
-    const Instruction* body = GetInstruction(ins->Refs[1]);
-    std::list<std::string> key_val = split(ins->Name, ',');
-    std::string key = key_val.front(), val = key_val.back();
-    Value objVal = Execute(iter_able_obj, ctx);
-    switch (objVal.Type) {
-    case ValueType::kString: {
-        for (size_t i = 0; i < objVal.bytes.size(); i++) {
-            if (key.size() > 0) {
-                ctx->SetVarValue(key, Value((long)i));
+        VM_CASE(DecVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            Value oldVal = slot ? *slot : ctx->GetVarValue(var.Name);
+            if (oldVal.Type != ValueType::kInteger) {
+                throw RuntimeException("-- operation only can used on Integer ");
+            }
+            if (slot != NULL) {
+                slot->Integer--;
+            } else {
+                oldVal.Integer--;
+                ctx->SetVarValue(var.Name, std::move(oldVal));
             }
-            ctx->SetVarValue(val, Value((long)objVal.bytes[i]));
-            Execute(body, ctx);
-            ctx->CleanContinueFlag();
-            if (ctx->IsExecutedInterupt()) {
+            VM_NEXT(1);
+        }
+        VM_CASE(Minus) {
+            Value& val = stack.back();
+            switch (val.Type) {
+            case ValueType::kInteger:
+                val.Integer = (-val.Integer);
+                break;
+            case ValueType::kFloat:
+                val.Float = (-val.Float);
                 break;
+            default:
+                throw RuntimeException("minus operation only can applay to integer or float");
             }
+            VM_NEXT(0);
+        }
+        VM_CASE(Not) {
+            stack.back() = Value(!stack.back().ToBoolean());
+            VM_NEXT(0);
         }
-    } break;
-    case ValueType::kArray: {
-        for (size_t i = 0; i < objVal._array().size(); i++) {
-            if (key.size() > 0) {
-                ctx->SetVarValue(key, Value((long)i));
+        VM_CASE(BNG) {
+            stack.back() = ~stack.back();
+            VM_NEXT(0);
+        }
+        VM_ARITHMETIC(ADD, +);
+        VM_ARITHMETIC(SUB, -);
+        VM_ARITHMETIC(MUL, *);
+        VM_BINARY(DIV, firstVal / secondVal);
+        VM_BINARY(MOD, firstVal % secondVal);
+        VM_COMPARE(GT, >);
+        VM_COMPARE(GE, >=);
+        VM_COMPARE(LT, <);
+        VM_COMPARE(LE, <=);
+        VM_COMPARE(EQ, ==);
+        VM_COMPARE(NE, !=);
+        VM_BINARY(BOR, firstVal | secondVal);
+        VM_BINARY(BAND, firstVal & secondVal);
+        VM_BINARY(BXOR, firstVal ^ secondVal);
+        VM_BINARY(LSHIFT, firstVal << secondVal);
+        VM_BINARY(RSHIFT, firstVal >> secondVal);
+        VM_BINARY(OR, Value(firstVal.ToBoolean() || secondVal.ToBoolean()));
+        VM_BINARY(AND, Value(firstVal.ToBoolean() && secondVal.ToBoolean()));
+        VM_CASE(Jump) {
+            pc = &code->Code[pc[1]];
+            VM_DISPATCH();
+        }
+        VM_CASE(JumpIfFalse) {
+            bool condition = stack.back().ToBoolean();
+            stack.pop_back();
+            if (!condition) {
+                pc = &code->Code[pc[1]];
+                VM_DISPATCH();
             }
-            ctx->SetVarValue(val, objVal._array()[i]);
-            Execute(body, ctx);
-            ctx->CleanContinueFlag();
-            if (ctx->IsExecutedInterupt()) {
-                break;
+            VM_NEXT(1);
+        }
+        VM_CASE(JumpIfTrue) {
+            bool condition = stack.back().ToBoolean();
+            stack.pop_back();
+            if (condition) {
+                pc = &code->Code[pc[1]];
+                VM_DISPATCH();
             }
+            VM_NEXT(1);
+        }
+        VM_CASE(EnterScope) {
+            scopes.push_back(
+                    mContextPool.New((VMContext::Type)pc[1], ctx, &code->Scopes[pc[2]]));
+            ctx = scopes.back().get();
+            VM_NEXT(2);
+        }
+        VM_CASE(LeaveScope) {
+            scopes.pop_back();
+            ctx = scopes.size() ? scopes.back().get() : root;
+            VM_NEXT(0);
         }
-    } break;
-    case ValueType::kMap: {
-        std::map<Value, Value>::iterator iter = objVal._map().begin();
-        while (iter != objVal._map().end()) {
-            if (key.size() > 0) {
-                ctx->SetVarValue(key, iter->first);
+        VM_CASE(Call) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            size_t count = pc[2];
+            ByteCode::CallCache& cache = code->CallCaches[pc[3]];
+            const ByteCode* function = cache.Function;
+            RUNTIME_FUNCTION builtin = cache.Builtin;
+            Value* slot = VM_SLOT(var);
+            if (slot != NULL || cache.Version != mCallSiteGuard.GetVersion() ||
+                !mCallSiteGuard.IsCacheable()) {
+                Value func;
+                if (slot != NULL) {
+                    func = *slot;
+                } else if (!ctx->GetVarValue(var.Name, func)) {
+                    func = GetFunction(var.Name, ctx);
+                    if (mCallSiteGuard.IsCacheable()) {
+                        cache.Version = mCallSiteGuard.GetVersion();
+                        cache.Function = func.Type == ValueType::kFunction ? func.Function : NULL;
+                        cache.Builtin =
+                                func.Type == ValueType::kRuntimeFunction ? func.RuntimeFunction : NULL;
+                    }
+                }
+                if (func.Type == ValueType::kFunction) {
+                    function = func.Function;
+                    builtin = NULL;
+                } else if (func.Type == ValueType::kRuntimeFunction) {
+                    function = NULL;
+                    builtin = func.RuntimeFunction;
+                } else {
+                    throw RuntimeException("can't as function called :" +
+                                           SymbolTable::Name(var.Name));
+                }
             }
-            ctx->SetVarValue(val, iter->second);
-            iter++;
-            Execute(body, ctx);
-            ctx->CleanContinueFlag();
-            if (ctx->IsExecutedInterupt()) {
-                break;
+            if (builtin != NULL) {
+                args.assign(std::make_move_iterator(stack.end() - count),
+                            std::make_move_iterator(stack.end()));
+                stack.resize(stack.size() - count);
+                Value val = builtin(args, ctx, this);
+                args.clear();
+                if (ctx->IsExitExecuted()) {
+                    return ctx->GetReturnValue();
+                }
+                stack.push_back(std::move(val));
+                VM_NEXT(3);
             }
+            scoped_refptr<VMContext> newCtx =
+                    mContextPool.New(VMContext::Function, ctx, &function->Scopes[0]);
+            BindParameters(function, var.Name, count ? &stack[stack.size() - count] : NULL,
+                           count, newCtx);
+            stack.resize(stack.size() - count);
+            Frame frame = {code, pc + 4, stack.size(), scopes.size(), iterators.size()};
+            frames.push_back(frame);
+            scopes.push_back(newCtx);
+            ctx = newCtx.get();
+            code = function;
+            pc = &code->Code[0];
+            VM_DISPATCH();
         }
-
-    } break;
-
-    default:
-        break;
-    }
-    return Value();
-}
-
-Value Executor::ExecuteCreateMap(const Instruction* ins, VMContext* ctx) {
-    const Instruction* list = GetInstruction(ins->Refs[0]);
-    if (list->OpCode == Instructions::kNop) {
-        return Value::make_map();
-    }
-    std::vector<const Instruction*> items = GetInstructions(list->Refs);
-    Value val = Value::make_map();
-    std::vector<const Instruction*>::iterator iter = items.begin();
-    while (iter != items.end()) {
-        const Instruction* key = GetInstruction((*iter)->Refs[0]);
-        const Instruction* value = GetInstruction((*iter)->Refs[1]);
-        Value keyVal = Execute(key, ctx);
-        Value valVal = Execute(value, ctx);
-        if (ctx->IsExecutedInterupt()) {
-            return Value();
-        }
-        val._map()[keyVal] = valVal;
-        iter++;
-    }
-    return val;
-}
-Value Executor::ExecuteCreateArray(const Instruction* ins, VMContext* ctx) {
-    const Instruction* list = GetInstruction(ins->Refs[0]);
-    if (list->OpCode == Instructions::kNop) {
-        return Value::make_array();
-    }
-    std::vector<const Instruction*> items = GetInstructions(list->Refs);
-    Value val = Value::make_array();
-    std::vector<const Instruction*>::iterator iter = items.begin();
-    while (iter != items.end()) {
-        val._array().push_back(Execute((*iter), ctx));
-        if (ctx->IsExecutedInterupt()) {
-            return Value();
+        VM_CASE(NewFunction) {
+            ctx->AddFunction(code->Functions[pc[1]]);
+            VM_NEXT(1);
         }
-        iter++;
-    }
-    return val;
-}
-Value Executor::ExecuteSlice(const Instruction* ins, VMContext* ctx) {
-    const Instruction* from = GetInstruction(ins->Refs[0]);
-    const Instruction* to = GetInstruction(ins->Refs[1]);
-    Value fromVal = Execute(from, ctx);
-    Value toVal = Execute(to, ctx);
-    Value opObj = ctx->GetVarValue(ins->Name);
-    return opObj.Slice(fromVal, toVal);
-}
-Value Executor::ExecuteWriteAt(const Instruction* ins, VMContext* ctx) {
-    const Instruction* where = GetInstruction(ins->Refs[0]);
-    Value toObject = ctx->GetVarValue(ins->Name);
-    const Instruction* value = GetInstruction(ins->Refs[1]);
-    Value elementValue = Execute(value, ctx);
-    if (where->OpCode != Instructions::kGroup) {
-        Value index = Execute(where, ctx);
-        toObject.SetValue(index, elementValue);
-        return Value();
-    }
-    std::vector<const Instruction*> indexInsList = GetInstructions(where->Refs);
-    std::vector<Value> indexValues = InstructionToValue(indexInsList, ctx);
-    for (size_t i = 0; i < indexValues.size() - 1; i++) {
-        toObject = toObject[indexValues[i]];
-    }
-    toObject.SetValue(indexValues.back(), elementValue);
-    return Value();
-}
-Value Executor::ExecuteReadAt(const Instruction* ins, VMContext* ctx) {
-    const Instruction* where = GetInstruction(ins->Refs[0]);
-    Value index = Execute(where, ctx);
-    if (ins->Refs.size() == 1) {
-        Value fromObject = ctx->GetVarValue(ins->Name);
-        return fromObject[index];
-    }
-    assert(ins->Name.size() == 0);
-    Value fromObject = Execute(GetInstruction(ins->Refs[1]), ctx);
-    return fromObject[index];
-}
-
-std::vector<Value> Executor::InstructionToValue(std::vector<const Instruction*> insList,
-                                                VMContext* ctx) {
-    std::vector<Value> result;
-    std::vector<const Instruction*>::iterator iter = insList.begin();
-    while (iter != insList.end()) {
-        result.push_back(Execute(*iter, ctx));
-        if (ctx->IsExecutedInterupt()) {
-            break;
+        VM_CASE(MakeFunction) {
+            stack.push_back(Value(code->Functions[pc[1]]));
+            VM_NEXT(1);
         }
-        iter++;
-    }
-    return result;
-}
-
-Value Executor::ExecuteSwitchStatement(const Instruction* ins, VMContext* ctx) {
-    const Instruction* value = GetInstruction(ins->Refs[0]);
-    const Instruction* cases = GetInstruction(ins->Refs[1]);
-    const Instruction* defaultBranch = GetInstruction(ins->Refs[2]);
-    std::vector<const Instruction*> case_array = GetInstructions(cases->Refs);
-    Value val = Execute(value, ctx);
-    std::vector<const Instruction*>::iterator iter = case_array.begin();
-    bool casehit = false;
-    while (iter != case_array.end()) {
-        std::vector<const Instruction*> conditions =
-                GetInstructions(GetInstruction((*iter)->Refs[0])->Refs);
-        std::vector<Value> condition_values = InstructionToValue(conditions, ctx);
-        const Instruction* actions = GetInstruction((*iter)->Refs[1]);
-        std::vector<Value>::iterator iter2 = condition_values.begin();
-        bool found = false;
-        while (iter2 != condition_values.end()) {
-            if (val == *iter2) {
-                found = true;
-                break;
+        VM_CASE(Return) {
+            if (frames.size() == 0) {
+                return std::move(stack.back());
             }
-            iter2++;
+            Value val = std::move(stack.back());
+            Frame& frame = frames.back();
+            stack.resize(frame.StackBase);
+            stack.push_back(std::move(val));
+            scopes.resize(frame.ScopeBase);
+            iterators.resize(frame.IteratorBase);
+            code = frame.Code;
+            pc = frame.PC;
+            frames.pop_back();
+            ctx = scopes.size() ? scopes.back().get() : root;
+            VM_DISPATCH();
         }
-        if (!found) {
-            iter++;
-            continue;
+        VM_CASE(Throw) { throw RuntimeException(code->Constants[pc[1]].Bytes()); }
+        VM_CASE(CreateMap) {
+            size_t count = pc[1];
+            Value val = Value::make_map();
+            for (size_t i = stack.size() - count * 2; i < stack.size(); i += 2) {
+                val._map()[stack[i]] = std::move(stack[i + 1]);
+            }
+            stack.resize(stack.size() - count * 2);
+            stack.push_back(std::move(val));
+            VM_NEXT(1);
         }
-        casehit = true;
-        Execute(actions, ctx);
-        if (ctx->IsExecutedInterupt()) {
-            break;
+        VM_CASE(CreateArray) {
+            size_t count = pc[1];
+            Value val = Value::make_array();
+            ArrayObject* array = val.Array();
+            for (size_t i = stack.size() - count; i < stack.size(); i++) {
+                array->Push(std::move(stack[i]));
+            }
+            stack.resize(stack.size() - count);
+            stack.push_back(std::move(val));
+            VM_NEXT(1);
         }
-        iter++;
-    }
-    if (casehit) {
-        return Value();
+        VM_CASE(CopyConst) {
+            //literals are mutable,every evaluation gets its own copy
+            Value literal = code->Constants[pc[1]];
+            if (literal.Type == ValueType::kArray) {
+                Value val = Value::make_array();
+                val.Array()->CopyFrom(*literal.Array());
+                stack.push_back(std::move(val));
+            } else {
+                Value val = Value::make_map();
+                val._map() = literal._map();
+                stack.push_back(std::move(val));
+            }
+            VM_NEXT(1);
+        }
+        VM_CASE(ReadAt) {
+            Value& index = stack[stack.size() - 2];
+            index = stack.back()[index];
+            stack.pop_back();
+            VM_NEXT(0);
+        }
+        VM_CASE(ReadAtVar) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            if (slot != NULL) {
+                stack.back() = (*slot)[stack.back()];
+            } else {
+                Value fromObject = ctx->GetVarValue(var.Name);
+                stack.back() = fromObject[stack.back()];
+            }
+            VM_NEXT(1);
+        }
+        VM_CASE(WriteAt) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            size_t count = pc[2];
+            Value toObject = slot ? *slot : ctx->GetVarValue(var.Name);
+            size_t base = stack.size() - count - 1;
+            for (size_t i = 1; i < count; i++) {
+                toObject = toObject[stack[base + i]];
+            }
+            toObject.SetValue(stack.back(), stack[base]);
+            stack.resize(base);
+            VM_NEXT(2);
+        }
+        VM_CASE(Slice) {
+            const ByteCode::VarRef& var = VM_VAR(pc[1]);
+            Value* slot = VM_SLOT(var);
+            //slice the variable in place instead of copying its payload first
+            Value named;
+            if (slot == NULL) {
+                named = ctx->GetVarValue(var.Name);
+                slot = &named;
+            }
+            Value& fromVal = stack[stack.size() - 2];
+            fromVal = slot->Slice(fromVal, stack.back());
+            stack.pop_back();
+            VM_NEXT(1);
+        }
+        VM_CASE(ForInBegin) {
+            iterators.push_back(ForInState());
+            ForInState& state = iterators.back();
+            state.Object = std::move(stack.back());
+            state.Index = 0;
+            if (state.Object.Type == ValueType::kMap) {
+                state.End = state.Object._map().end().Position();
+                state.Lock = MAPTYPE::IterationLock(&state.Object._map());
+            }
+            stack.pop_back();
+            VM_NEXT(0);
+        }
+        VM_CASE(ForInNext) {
+            ForInState& state = iterators.back();
+            Value key, val;
+            switch (state.Object.Type) {
+            case ValueType::kString:
+                if (state.Index >= state.Object.Bytes().size()) {
+                    pc = &code->Code[pc[3]];
+                    VM_DISPATCH();
+                }
+                key = Value((long)state.Index);
+                val = Value((long)state.Object.Bytes()[state.Index]);
+                state.Index++;
+                break;
+            case ValueType::kArray:
+                if (state.Index >= state.Object.Array()->size()) {
+                    pc = &code->Code[pc[3]];
+                    VM_DISPATCH();
+                }
+                key = Value((long)state.Index);
+                val = state.Object.Array()->Get(state.Index);
+                state.Index++;
+                break;
+            case ValueType::kMap: {
+                //the iterator skips the entries the loop body removed
+                MAPTYPE::iterator iter(&state.Object._map(), state.Index);
+                if (iter.Position() >= state.End) {
+                    pc = &code->Code[pc[3]];
+                    VM_DISPATCH();
+                }
+                key = iter->first;
+                val = iter->second;
+                state.Index = iter.Position() + 1;
+                break;
+            }
+            default:
+                pc = &code->Code[pc[3]];
+                VM_DISPATCH();
+            }
+            if (pc[1] != -1) {
+                Value* slot = VM_SLOT(VM_VAR(pc[1]));
+                if (slot != NULL) {
+                    *slot = std::move(key);
+                } else {
+                    ctx->SetVarValue(VM_VAR(pc[1]).Name, std::move(key));
+                }
+            }
+            Value* slot = VM_SLOT(VM_VAR(pc[2]));
+            if (slot != NULL) {
+                *slot = std::move(val);
+            } else {
+                ctx->SetVarValue(VM_VAR(pc[2]).Name, std::move(val));
+            }
+            VM_NEXT(3);
+        }
+        VM_CASE(ForInEnd) {
+            iterators.pop_back();
+            VM_NEXT(0);
+        }
+        VM_CASE(End) { return Value(); }
     }
-    Execute(defaultBranch, ctx);
     return Value();
 }
 
-} // namespace Interpreter
\ No newline at end of file
+} // namespace Interpreter
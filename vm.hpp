@@ -1,8 +1,11 @@
 #pragma once
+#include <stdio.h>
+
 #include <map>
 #include <string>
 #include <vector>
 
+#include "compiler.hpp"
 #include "exception.hpp"
 #include "logger.hpp"
 #include "script.hpp"
@@ -26,42 +29,59 @@ public:
 class Executor {
 public:
     Executor(ExecutorCallback* callback);
+    ~Executor();
 
 public:
     bool Execute(scoped_refptr<Script> script, std::string& errmsg, bool showWarning = false);
     void RegisgerFunction(BuiltinMethod methods[], int count);
     Value CallScriptFunction(const std::string& name, std::vector<Value>& value, VMContext* ctx);
+    Value CallScriptFunction(const ByteCode* func, std::vector<Value>& value, VMContext* ctx);
     void RequireScript(const std::string& name, VMContext* ctx);
     Value GetAvailableFunction(VMContext* ctx);
+    //script output (Println) goes here,stdout unless the caller captures it
+    void SetOutput(FILE* output) { mOutput = output; }
+    FILE* GetOutput() const { return mOutput; }
+    //state a module keeps for the executor (kept between Execute calls),NULL until the
+    //module sets it.it's closed and released with the executor
+    Resource* GetModuleData(const std::string& name);
+    void SetModuleData(const std::string& name, Resource* data);
 
 protected:
-    Value Execute(const Instruction* ins, VMContext* ctx);
-    Value ExecuteList(std::vector<const Instruction*> insList, VMContext* ctx);
-    Value CallFunction(const Instruction* ins, VMContext* ctx);
-    Value CallRutimeFunction(const Instruction* ins, VMContext* ctx,RUNTIME_FUNCTION method);
-    Value CallScriptFunction(const Instruction* ins, VMContext* ctx,const Instruction*func);
-    Value ExecuteIfStatement(const Instruction* ins, VMContext* ctx);
-    Value ExecuteForStatement(const Instruction* ins, VMContext* ctx);
-    Value ExecuteForInStatement(const Instruction* ins, VMContext* ctx);
-    Value ExecuteArithmeticOperation(const Instruction* ins, VMContext* ctx);
-    Value ExecuteUpdateVar(const Instruction* ins, VMContext* ctx);
-    Value ExecuteCreateMap(const Instruction* ins, VMContext* ctx);
-    Value ExecuteCreateArray(const Instruction* ins, VMContext* ctx);
-    Value ExecuteSlice(const Instruction* ins, VMContext* ctx);
-    Value ExecuteWriteAt(const Instruction* ins, VMContext* ctx);
-    Value ExecuteReadAt(const Instruction* ins, VMContext* ctx);
-    Value ExecuteSwitchStatement(const Instruction* ins, VMContext* ctx);
-    Value GetVarOrFunction(const std::string&name,VMContext* ctx);
-    RUNTIME_FUNCTION GetBuiltinMethod(const std::string& name);
-    const Instruction* GetInstruction(Instruction::keyType key);
-    std::vector<const Instruction*> GetInstructions(std::vector<Instruction::keyType> keys);
-    Value GetConstValue(Instruction::keyType key);
-    std::vector<Value> InstructionToValue(std::vector<const Instruction*> ins,
-                                          VMContext* ctx);
+    struct Frame {
+        const ByteCode* Code;
+        const int* PC;
+        size_t StackBase;
+        size_t ScopeBase;
+        size_t IteratorBase;
+    };
+    struct ForInState {
+        Value Object;
+        //next position in the string,array or map entry list
+        size_t Index;
+        //position after the last map entry when the loop began,keys inserted by the
+        //loop body are not visited
+        size_t End;
+        MAPTYPE::IterationLock Lock;
+    };
+    const ByteCode* Compile(const Script* script);
+    //run the bytecode until it's top level returned
+    Value Run(const ByteCode* entry, VMContext* ctx);
+    void BindParameters(const ByteCode* func, Symbol name, Value* args, size_t count,
+                        VMContext* ctx);
+    Value GetVarOrFunction(Symbol name, VMContext* ctx);
+    Value GetFunction(Symbol name, VMContext* ctx);
+    RUNTIME_FUNCTION GetBuiltinMethod(Symbol name);
+    void UpdateValue(Value& oldVal, const Value& val, Instructions::Type op);
 
 protected:
     ExecutorCallback* mCallback;
+    FILE* mOutput;
     std::list<scoped_refptr<Script>> mScriptList;
-    std::map<std::string, RUNTIME_FUNCTION> mBuiltinMethods;
+    std::vector<ByteCode*> mByteCodes;
+    //indexed by symbol,NULL for names which are not builtin
+    std::vector<RUNTIME_FUNCTION> mBuiltinMethods;
+    CallSiteGuard mCallSiteGuard;
+    VMContextPool mContextPool;
+    std::map<std::string, RESOURCE> mModuleData;
 };
 } // namespace Interpreter
\ No newline at end of file
@@ -1,135 +1,220 @@
 #include "vmcontext.hpp"
+
+#include <algorithm>
+
+#include "compiler.hpp"
 bool IsFunctionOverwriteEnabled(const std::string& name);
 namespace Interpreter {
 
 struct BuiltinValue {
-    std::string Name;
+    Symbol Name;
     Value val;
 };
 
 BuiltinValue g_builtinVar[] = {
-        {"false", Value(0l)},
-        {"true", Value(1l)},
-        {"nil", Value()},
+        {SymbolTable::Intern("false"), Value(0l)},
+        {SymbolTable::Intern("true"), Value(1l)},
+        {SymbolTable::Intern("nil"), Value()},
 };
 
 #define COUNT_OF(a) (sizeof(a) / sizeof(a[0]))
 
-VMContext::VMContext(Type type, VMContext* Parent) : mFlags(0), mIsEnableWarning(false) {
+VMContext::VMContext(Type type, VMContext* Parent, const std::vector<Symbol>* slotNames)
+        : mPool(NULL) {
+    Init(type, Parent, slotNames);
+}
+VMContext::~VMContext() {
+    Clear();
+}
+
+void VMContext::Init(Type type, VMContext* Parent, const std::vector<Symbol>* slotNames) {
+    mFlags = 0;
+    mIsEnableWarning = false;
+    mSlotNames = slotNames;
+    mHasNamedVar = false;
+    mCallSiteGuard = NULL;
+    mShadowVars = 0;
+    if (mSlotNames != NULL) {
+        mSlots.resize(mSlotNames->size());
+    }
     mParent = Parent;
     mType = type;
     mDeepth = 0;
     if (mParent != NULL) {
         mDeepth = mParent->mDeepth + 1;
         mIsEnableWarning = mParent->mIsEnableWarning;
+        mCallSiteGuard = mParent->mCallSiteGuard;
     }
-    LoadBuiltinVar();
 }
-VMContext::~VMContext() {}
 
-bool VMContext::IsBuiltinVarName(const std::string& name) {
-    for (int i = 0; i < COUNT_OF(g_builtinVar); i++) {
-        if (g_builtinVar[i].Name == name) {
-            return false;
-        }
+void VMContext::Clear() {
+    if (mShadowVars) {
+        mCallSiteGuard->mShadowCount -= mShadowVars;
+        mShadowVars = 0;
     }
-    return true;
+    mSlots.clear();
+    mVars.clear();
+    mFunctions.clear();
+    mReturnValue = Value();
 }
 
-void VMContext::LoadBuiltinVar() {
-    for (int i = 0; i < COUNT_OF(g_builtinVar); i++) {
-        mVars[g_builtinVar[i].Name] = g_builtinVar[i].val;
+void VMContextTraits::Destruct(const VMContext* ctx) {
+    VMContext* obj = const_cast<VMContext*>(ctx);
+    if (obj->mPool != NULL) {
+        obj->mPool->Release(obj);
+        return;
     }
+    delete obj;
 }
 
-void VMContext::BreakExecuted() {
-    if (!IsBreakAvaliable()) {
-        throw RuntimeException("break only avaliable in for or switch statement");
+VMContextPool::~VMContextPool() {
+    for (size_t i = 0; i < mFree.size(); i++) {
+        mFree[i]->mPool = NULL;
+        delete mFree[i];
     }
-    mFlags |= BREAK_FLAG;
+    mFree.clear();
 }
 
-void VMContext::ContinueExecuted() {
-    if (!IsContinueAvaliable()) {
-        throw RuntimeException("continue only avaliable in for statement");
+VMContext* VMContextPool::New(VMContext::Type type, VMContext* Parent,
+                              const std::vector<Symbol>* slotNames) {
+    if (mFree.size() == 0) {
+        VMContext* ctx = new VMContext(type, Parent, slotNames);
+        ctx->mPool = this;
+        return ctx;
     }
-    mFlags |= CONTINUE_FLAG;
+    VMContext* ctx = mFree.back();
+    mFree.pop_back();
+    ctx->Init(type, Parent, slotNames);
+    return ctx;
 }
 
-void VMContext::ExitExecuted(Value exitCode) {
-    VMContext* seek = this;
-    while (seek) {
-        seek->mFlags |= EXIT_FLAG;
-        seek->mReturnValue = exitCode;
-        seek = seek->mParent;
+void VMContextPool::Release(VMContext* ctx) {
+    ctx->Clear();
+    mFree.push_back(ctx);
+}
+
+//all alive contexts are on the chain of the current one,so the variables
+//which already use the new function name can be found here
+void CallSiteGuard::AddFunctionName(Symbol name, VMContext* ctx) {
+    mVersion++;
+    if (IsFunctionName(name)) {
+        return;
+    }
+    if (name >= mFunctionNames.size()) {
+        mFunctionNames.resize(name + 1);
+    }
+    mFunctionNames[name] = true;
+    while (ctx != NULL) {
+        if (ctx->FindLocalVar(name) != NULL) {
+            ctx->mShadowVars++;
+            mShadowCount++;
+        }
+        ctx = ctx->mParent;
     }
 }
 
-void VMContext::ReturnExecuted(Value retVal) {
-    if (!IsInFunctionContext()) {
-        throw RuntimeException("return only avaliable in function statement");
+void VMContext::VarCreated(Symbol name) {
+    if (mCallSiteGuard != NULL && mCallSiteGuard->IsFunctionName(name)) {
+        mShadowVars++;
+        mCallSiteGuard->mShadowCount++;
     }
-    VMContext* seek = this;
-    while (seek) {
-        seek->mFlags |= RETURN_FLAG;
-        seek->mReturnValue = retVal;
-        if (seek->mType == Function) {
-            break;
+}
+
+bool VMContext::IsBuiltinVarName(Symbol name) {
+    for (int i = 0; i < COUNT_OF(g_builtinVar); i++) {
+        if (g_builtinVar[i].Name == name) {
+            return false;
         }
-        seek = seek->mParent;
     }
+    return true;
 }
 
-bool VMContext::IsInFunctionContext() {
-    VMContext* seek = this;
-    while (seek) {
-        if (seek->mType == Function) {
+bool VMContext::GetBuiltinVar(Symbol name, Value& val) {
+    for (int i = 0; i < COUNT_OF(g_builtinVar); i++) {
+        if (g_builtinVar[i].Name == name) {
+            val = g_builtinVar[i].val;
             return true;
         }
-        seek = seek->mParent;
     }
     return false;
 }
 
-void VMContext::AddVar(const std::string& name) {
+void VMContext::ExitExecuted(Value exitCode) {
+    VMContext* seek = this;
+    while (seek) {
+        seek->mFlags |= EXIT_FLAG;
+        seek->mReturnValue = exitCode;
+        seek = seek->mParent;
+    }
+}
+
+void VMContext::AddVar(Symbol name) {
     if (!IsBuiltinVarName(name)) {
-        throw RuntimeException("variable name is builtin :" + name);
+        throw RuntimeException("variable name is builtin :" + SymbolTable::Name(name));
     }
     if (mIsEnableWarning && IsShadowName(name)) {
-        LOG("variable name shadow :" + name);
+        LOG("variable name shadow :" + SymbolTable::Name(name));
     }
-    std::map<std::string, Value>::iterator iter = mVars.find(name);
-    if (iter == mVars.end()) {
-        mVars[name] = Value();
+    if (FindLocalVar(name) != NULL) {
+        throw RuntimeException("variable already exist name:" + SymbolTable::Name(name));
+    }
+    VarCreated(name);
+    int slot = FindSlot(name);
+    if (slot != -1) {
+        mSlots[slot].Declared = true;
         return;
     }
-    throw RuntimeException("variable already exist name:" + name);
+    mVars[name] = Value();
+    mHasNamedVar = true;
 }
 
-void VMContext::SetVarValue(const std::string& name, Value value) {
+void VMContext::AddVar(int slot) {
+    Symbol name = (*mSlotNames)[slot];
     if (!IsBuiltinVarName(name)) {
-        throw RuntimeException("variable not changable,because name is builtin :" + name);
+        throw RuntimeException("variable name is builtin :" + SymbolTable::Name(name));
+    }
+    if (mIsEnableWarning && IsShadowName(name)) {
+        LOG("variable name shadow :" + SymbolTable::Name(name));
+    }
+    if (FindLocalVar(name) != NULL) {
+        throw RuntimeException("variable already exist name:" + SymbolTable::Name(name));
+    }
+    VarCreated(name);
+    mSlots[slot].Declared = true;
+}
+
+void VMContext::SetVarValue(Symbol name, Value value) {
+    if (!IsBuiltinVarName(name)) {
+        throw RuntimeException("variable not changable,because name is builtin :" +
+                               SymbolTable::Name(name));
     }
     VMContext* ctx = this;
     while (ctx != NULL) {
-        std::map<std::string, Value>::iterator iter = ctx->mVars.find(name);
-        if (iter != ctx->mVars.end()) {
-            iter->second = value;
+        Value* val = ctx->FindLocalVar(name);
+        if (val != NULL) {
+            *val = std::move(value);
             return;
         }
         ctx = ctx->mParent;
     }
     if (mIsEnableWarning) {
-        LOG("variable <" + name + "> not found, so new one.");
+        LOG("variable <" + SymbolTable::Name(name) + "> not found, so new one.");
     }
-    mVars[name] = value;
+    VarCreated(name);
+    int slot = FindSlot(name);
+    if (slot != -1) {
+        mSlots[slot].Declared = true;
+        mSlots[slot].Val = std::move(value);
+        return;
+    }
+    mVars[name] = std::move(value);
+    mHasNamedVar = true;
 }
 
-bool VMContext::IsShadowName(const std::string& name) {
+bool VMContext::IsShadowName(Symbol name) {
     VMContext* ctx = this;
     while (ctx != NULL) {
-        std::map<std::string, Value>::iterator iter = ctx->mVars.find(name);
-        if (iter != ctx->mVars.end()) {
+        if (ctx->FindLocalVar(name) != NULL) {
             return true;
         }
         ctx = ctx->mParent;
@@ -137,49 +222,74 @@ bool VMContext::IsShadowName(const std::string& name) {
     return false;
 }
 
-bool VMContext::GetVarValue(const std::string& name, Value& val) {
+Value* VMContext::FindLocalVar(Symbol name) {
+    for (size_t i = 0; i < mSlots.size(); i++) {
+        if (mSlots[i].Declared && (*mSlotNames)[i] == name) {
+            return &mSlots[i].Val;
+        }
+    }
+    std::map<Symbol, Value>::iterator iter = mVars.find(name);
+    if (iter != mVars.end()) {
+        return &iter->second;
+    }
+    return NULL;
+}
+
+int VMContext::FindSlot(Symbol name) {
+    for (size_t i = 0; i < mSlots.size(); i++) {
+        if ((*mSlotNames)[i] == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool VMContext::GetVarValue(Symbol name, Value& val) {
     VMContext* ctx = this;
     while (ctx != NULL) {
-        std::map<std::string, Value>::iterator iter = ctx->mVars.find(name);
-        if (iter != ctx->mVars.end()) {
-            val = iter->second;
+        Value* item = ctx->FindLocalVar(name);
+        if (item != NULL) {
+            val = *item;
             return true;
         }
         ctx = ctx->mParent;
     }
-    return false;
-    throw RuntimeException("variable not found :" + name);
+    return GetBuiltinVar(name, val);
 }
-Value VMContext::GetVarValue(const std::string& name) {
+Value VMContext::GetVarValue(Symbol name) {
     Value ret;
     if (!GetVarValue(name, ret)) {
-        throw RuntimeException("variable not found :" + name);
+        throw RuntimeException("variable not found :" + SymbolTable::Name(name));
     }
     return ret;
 }
 
-void VMContext::AddFunction(const Instruction* obj) {
+void VMContext::AddFunction(const ByteCode* obj) {
     if (mType != File) {
-        throw RuntimeException("function declaration must in the top block name:" + obj->Name);
+        throw RuntimeException("function declaration must in the top block name:" +
+                               SymbolTable::Name(obj->Name));
     }
-    if (!IsFunctionOverwriteEnabled(obj->Name)) {
+    if (!IsFunctionOverwriteEnabled(SymbolTable::Name(obj->Name))) {
         throw RuntimeException("exit function can't overwrite");
     }
     //LOG("add function:"+obj->Name);
-    std::map<std::string, const Instruction*>::iterator iter = mFunctions.find(obj->Name);
+    std::map<Symbol, const ByteCode*>::iterator iter = mFunctions.find(obj->Name);
     if (iter == mFunctions.end()) {
         mFunctions[obj->Name] = obj;
+        if (mCallSiteGuard != NULL) {
+            mCallSiteGuard->AddFunctionName(obj->Name, this);
+        }
         return;
     }
-    throw RuntimeException("function already exist name:" + obj->Name);
+    throw RuntimeException("function already exist name:" + SymbolTable::Name(obj->Name));
 }
 
-const Instruction* VMContext::GetFunction(const std::string& name) {
+const ByteCode* VMContext::GetFunction(Symbol name) {
     VMContext* ctx = this;
     while (ctx->mParent != NULL) {
         ctx = ctx->mParent;
     }
-    std::map<std::string, const Instruction*>::iterator iter = ctx->mFunctions.find(name);
+    std::map<Symbol, const ByteCode*>::iterator iter = ctx->mFunctions.find(name);
     if (iter == ctx->mFunctions.end()) {
         return NULL;
     }
@@ -191,12 +301,15 @@ Value VMContext::GetTotalFunction() {
     while (ctx->mParent != NULL) {
         ctx = ctx->mParent;
     }
-    std::vector<Value> functions;
-    std::map<std::string, const Instruction*>::iterator iter = ctx->mFunctions.begin();
+    //sorted by name
+    std::vector<std::string> names;
+    std::map<Symbol, const ByteCode*>::iterator iter = ctx->mFunctions.begin();
     while (iter != ctx->mFunctions.end()) {
-        functions.push_back(Value(iter->first));
+        names.push_back(SymbolTable::Name(iter->first));
         iter++;
     }
+    std::sort(names.begin(), names.end());
+    std::vector<Value> functions(names.begin(), names.end());
     return Value(functions);
 }
 
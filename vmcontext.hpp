@@ -4,11 +4,42 @@
 #include <vector>
 
 #include "script.hpp"
+#include "symbol.hpp"
 #include "value.hpp"
 
 namespace Interpreter {
 
-class VMContext : public CRefCountedThreadSafe<VMContext> {
+class ByteCode;
+class VMContext;
+class VMContextPool;
+
+//contexts created by a pool go back to it when released
+struct VMContextTraits {
+    static void Destruct(const VMContext* ctx);
+};
+
+//call sites cache the function they resolved,the cache is valid while the version
+//not changed and no variable which shadows a function name alive
+class CallSiteGuard {
+public:
+    CallSiteGuard() : mVersion(1), mShadowCount(0) {}
+    unsigned int GetVersion() { return mVersion; }
+    bool IsCacheable() { return mShadowCount == 0; }
+    bool IsFunctionName(Symbol name) {
+        return name < mFunctionNames.size() && mFunctionNames[name];
+    }
+    void Invalidate() { mVersion++; }
+    void AddFunctionName(Symbol name, VMContext* ctx);
+
+protected:
+    friend class VMContext;
+    unsigned int mVersion;
+    int mShadowCount;
+    //indexed by symbol
+    std::vector<bool> mFunctionNames;
+};
+
+class VMContext : public CRefCountedThreadSafe<VMContext, VMContextTraits> {
 public:
     enum Type {
         File,
@@ -19,10 +50,7 @@ public:
 
 protected:
     enum {
-        CONTINUE_FLAG = (1 << 0),
-        BREAK_FLAG = (1 << 1),
-        RETURN_FLAG = (1 << 2),
-        EXIT_FLAG = (1 << 3),
+        EXIT_FLAG = (1 << 0),
     };
 
     VMContext* mParent;
@@ -36,42 +64,84 @@ protected:
     VMContext& operator=(const VMContext&);
 
 public:
-    VMContext(Type type, VMContext* Parent);
+    VMContext(Type type, VMContext* Parent, const std::vector<Symbol>* slotNames = NULL);
     ~VMContext();
 
     void SetEnableWarning(bool val) { mIsEnableWarning = val; }
+    void SetCallSiteGuard(CallSiteGuard* guard) { mCallSiteGuard = guard; }
 
     bool IsTop() { return mParent == NULL; }
-    bool IsExecutedInterupt() { return (mFlags & 0xFF); }
-    void CleanContinueFlag() { mFlags &= 0xFE; }
-    void BreakExecuted();
-    void ContinueExecuted();
+    static bool GetBuiltinVar(Symbol name, Value& val);
+    bool IsExitExecuted() { return (mFlags & EXIT_FLAG); }
     void ExitExecuted(Value exitCode);
-    void ReturnExecuted(Value retVal);
     Value GetReturnValue() { return mReturnValue; }
 
-    bool IsReturnAvaliable() { return IsInFunctionContext(); }
-    bool IsBreakAvaliable() { return mType == For || mType == Switch; }
-    bool IsContinueAvaliable() { return mType == For; }
-    bool IsInFunctionContext();
-
-    void AddVar(const std::string& name);
-    void SetVarValue(const std::string& name, Value value);
-    bool GetVarValue(const std::string& name, Value& val);
-    Value GetVarValue(const std::string& name);
-    void AddFunction(const Instruction* function);
-    const Instruction* GetFunction(const std::string& name);
+    void AddVar(Symbol name);
+    void AddVar(int slot);
+    //returns NULL when the slot not declared yet or a scope between may shadow it,
+    //the caller must fall back to lookup by name
+    Value* GetSlot(int depth, int slot) {
+        VMContext* ctx = this;
+        for (; depth > 0; depth--) {
+            if (ctx->mHasNamedVar) {
+                return NULL;
+            }
+            ctx = ctx->mParent;
+        }
+        VarSlot& item = ctx->mSlots[slot];
+        return item.Declared ? &item.Val : NULL;
+    }
+    void SetVarValue(Symbol name, Value value);
+    bool GetVarValue(Symbol name, Value& val);
+    Value GetVarValue(Symbol name);
+    void AddFunction(const ByteCode* function);
+    const ByteCode* GetFunction(Symbol name);
 
     Value GetTotalFunction();
 
 protected:
-    void LoadBuiltinVar();
-    bool IsBuiltinVarName(const std::string& name);
-    bool IsShadowName(const std::string& name);
+    friend class CallSiteGuard;
+    friend class VMContextPool;
+    friend struct VMContextTraits;
+    void Init(Type type, VMContext* Parent, const std::vector<Symbol>* slotNames);
+    void Clear();
+    bool IsBuiltinVarName(Symbol name);
+    bool IsShadowName(Symbol name);
+    Value* FindLocalVar(Symbol name);
+    int FindSlot(Symbol name);
+    void VarCreated(Symbol name);
+
+private:
+    struct VarSlot {
+        Value Val;
+        bool Declared;
+        VarSlot() : Declared(false) {}
+    };
+    //variables declared in this scope and resolved by the compiler
+    const std::vector<Symbol>* mSlotNames;
+    std::vector<VarSlot> mSlots;
+    //set when a variable without slot created in this scope
+    bool mHasNamedVar;
+    CallSiteGuard* mCallSiteGuard;
+    //count of variables in this scope which shadow a function name
+    int mShadowVars;
+    std::map<Symbol, Value> mVars;
+    std::map<Symbol, const ByteCode*> mFunctions;
+    VMContextPool* mPool;
+};
+
+//reuse the contexts of loops,switches and calls instead of allocating them every time
+class VMContextPool {
+public:
+    VMContextPool() {}
+    ~VMContextPool();
+    VMContext* New(VMContext::Type type, VMContext* Parent,
+                   const std::vector<Symbol>* slotNames);
+    void Release(VMContext* ctx);
 
 private:
-    std::map<std::string, Value> mVars;
-    std::map<std::string, const Instruction*> mFunctions;
+    std::vector<VMContext*> mFree;
+    DISALLOW_COPY_AND_ASSIGN(VMContextPool);
 };
 
 } // namespace Interpreter
\ No newline at end of file